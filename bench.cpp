@@ -0,0 +1,377 @@
+#include "binary_proto.h"
+#include "calc_core.h"
+#include "epoll_wrapper.h"
+#include "logger.h"
+#include "metrics.h"
+#include "server.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Микробенчмарки calc_server. Каждый результат — одна строка JSON на stdout,
+// чтобы сборки можно было сравнивать скриптом. Входные данные детерминированы
+// (фиксированный seed), время — медиана из нескольких повторов.
+
+struct BenchOptions {
+    std::string filter;      // запускать только бенчмарки, в имени которых есть подстрока
+    double min_time_ms = 200; // минимальное время одного повтора
+    int repeats = 5;
+};
+
+static BenchOptions g_opts;
+
+static bool selected(const std::string &name) {
+    return g_opts.filter.empty() || name.find(g_opts.filter) != std::string::npos;
+}
+
+// Подобрать число итераций так, чтобы повтор длился не меньше min_time,
+// и вернуть медиану нс/итерацию по повторам
+static double measure(const std::function<void(uint64_t)> &body, uint64_t &iters_out) {
+    uint64_t iters = 1;
+    while (true) {
+        uint64_t t0 = now_ns();
+        body(iters);
+        double ms = (now_ns() - t0) / 1e6;
+        if (ms >= g_opts.min_time_ms || iters >= (1ULL << 40)) break;
+        double scale = ms > 0 ? g_opts.min_time_ms / ms * 1.2 : 10;
+        iters = std::max<uint64_t>(iters + 1, uint64_t(iters * std::min(scale, 10.0)));
+    }
+    std::vector<double> samples;
+    for (int r = 0; r < g_opts.repeats; ++r) {
+        uint64_t t0 = now_ns();
+        body(iters);
+        samples.push_back(double(now_ns() - t0) / iters);
+    }
+    std::sort(samples.begin(), samples.end());
+    iters_out = iters;
+    return samples[samples.size() / 2];
+}
+
+// Чтобы компилятор не выбросил вычисления
+static volatile double g_sink;
+
+// Выражение из n чисел (1–100) с операторами + - * / и скобками до глубины depth.
+// Генератор детерминирован.
+static std::string make_expr(int n, int depth, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> num(1, 100);
+    const char ops[] = {'+', '-', '*', '/'};
+    std::string s;
+    int open = 0;
+    for (int i = 0; i < n; ++i) {
+        if (i > 0) {
+            // закрываем скобку, если глубина достигнута, с вероятностью 1/4
+            while (open > 0 && rng() % 4 == 0) { s += " )"; --open; }
+            s += ' ';
+            s += ops[rng() % 4];
+            s += ' ';
+        }
+        while (open < depth && i + 1 < n && rng() % 2 == 0) { s += "( "; ++open; }
+        s += std::to_string(num(rng));
+    }
+    while (open-- > 0) s += " )";
+    return s;
+}
+
+// ---------------- Разбор ----------------
+
+static void bench_parser() {
+    const int sizes[] = {10, 100, 1000, 10000, 100000};
+    const int depths[] = {0, 8, 64};
+    for (int n : sizes) {
+        for (int depth : depths) {
+            // Берём первое выражение, которое вычисляется без ошибки (деление на ноль
+            // и переполнение меряли бы уже путь исключения)
+            std::string e;
+            double expected = 0;
+            for (uint64_t seed = 42 + n + depth;; ++seed) {
+                e = make_expr(n, depth, seed);
+                try {
+                    expected = ExprParser(e).parse();
+                    break;
+                } catch (const std::exception &) {}
+            }
+            std::string frame;
+            encode_binary_frame(e, frame);
+            std::string wrapped = "( " + e + " )"; // та же величина, другая форма
+            struct Case { const char *impl; std::function<void(uint64_t)> body; };
+            Case cases[] = {
+                {"ExprParser_cached", [&](uint64_t it) {
+                    // одно выражение: форма из кэша потока после первого вызова
+                    for (uint64_t k = 0; k < it; ++k) g_sink = ExprParser(e).parse();
+                }},
+                {"ExprCompiler_miss", [&](uint64_t it) {
+                    // кэш на одну форму и две чередующиеся формы: каждый вызов — промах с компиляцией
+                    ExprCompiler comp(1);
+                    for (uint64_t k = 0; k < it; ++k) {
+                        double r = 0;
+                        comp.evaluate(k % 2 ? wrapped : e, r);
+                        g_sink = r;
+                    }
+                }},
+                {"ExprProgram_compile", [&](uint64_t it) {
+                    // без кэша форм: разбор, компиляция и запуск каждый раз
+                    std::string shape;
+                    std::vector<double> consts, stack;
+                    ExprProgram prog;
+                    for (uint64_t k = 0; k < it; ++k) {
+                        double r = 0;
+                        if (tokenize_expr(e, shape, consts) && prog.compile(shape))
+                            prog.run(consts.data(), stack, r);
+                        g_sink = r;
+                    }
+                }},
+                {"ExprProgram_run", [&](uint64_t it) {
+                    // только цикл байткода на готовых константах
+                    std::string shape;
+                    std::vector<double> consts, stack;
+                    ExprProgram prog;
+                    tokenize_expr(e, shape, consts);
+                    prog.compile(shape);
+                    for (uint64_t k = 0; k < it; ++k) {
+                        double r = 0;
+                        prog.run(consts.data(), stack, r);
+                        g_sink = r;
+                    }
+                }},
+                {"StreamEvaluator", [&](uint64_t it) {
+                    StreamEvaluator ev;
+                    for (uint64_t k = 0; k < it; ++k) {
+                        ev.reset();
+                        ev.feed(e.data(), e.size());
+                        double r;
+                        ev.finish(r);
+                        g_sink = r;
+                    }
+                }},
+                {"StreamEvaluator_frag8", [&](uint64_t it) {
+                    StreamEvaluator ev;
+                    for (uint64_t k = 0; k < it; ++k) {
+                        ev.reset();
+                        for (size_t off = 0; off < e.size(); off += 8)
+                            ev.feed(e.data() + off, std::min<size_t>(8, e.size() - off));
+                        double r;
+                        ev.finish(r);
+                        g_sink = r;
+                    }
+                }},
+                {"BinaryDecoder", [&](uint64_t it) {
+                    // то же выражение кадром двоичного протокола
+                    BinaryDecoder dec;
+                    StreamEvaluator ev;
+                    for (uint64_t k = 0; k < it; ++k)
+                        dec.feed(frame.data(), frame.size(), ev, [](bool, double v) { g_sink = v; });
+                }},
+            };
+            for (auto &c : cases) {
+                std::string name = std::string("parse/") + c.impl;
+                if (!selected(name)) continue;
+                uint64_t iters;
+                double ns = measure(c.body, iters);
+                printf("{\"bench\":\"%s\",\"n\":%d,\"depth\":%d,\"bytes\":%zu,\"iters\":%llu,"
+                       "\"ns_per_op\":%.1f,\"mb_per_s\":%.1f,\"result\":%.6f}\n",
+                       name.c_str(), n, depth, e.size(), (unsigned long long)iters, ns,
+                       e.size() / ns * 1e3, expected);
+                fflush(stdout);
+            }
+        }
+    }
+}
+
+// ---------------- Цикл событий ----------------
+
+static void bench_epoll(Epoll::Backend backend, const char *backend_name) {
+    Epoll probe(backend);
+    if (probe.backend() != backend) return; // бэкенд недоступен
+    int efd = eventfd(0, EFD_NONBLOCK);
+    epoll_event events[8];
+    struct Case { const char *op; std::function<void(uint64_t)> body; };
+    Case cases[] = {
+        {"add_remove", [&](uint64_t it) {
+            Epoll ep(backend);
+            for (uint64_t k = 0; k < it; ++k) {
+                ep.add(efd, EPOLLIN);
+                ep.remove(efd);
+                if ((k & 63) == 63) ep.wait(events, 8, 0); // io_uring: отправить накопленное
+            }
+        }},
+        {"modify", [&](uint64_t it) {
+            Epoll ep(backend);
+            ep.add(efd, EPOLLIN);
+            for (uint64_t k = 0; k < it; ++k) {
+                ep.modify(efd, (k & 1) ? EPOLLIN : EPOLLIN | EPOLLET);
+                if ((k & 63) == 63) ep.wait(events, 8, 0);
+            }
+        }},
+        {"wait_idle", [&](uint64_t it) {
+            Epoll ep(backend);
+            ep.add(efd, EPOLLIN);
+            for (uint64_t k = 0; k < it; ++k) g_sink = ep.wait(events, 8, 0);
+        }},
+        {"wait_ready", [&](uint64_t it) {
+            // eventfd всегда готов к чтению, регистрация по уровню
+            Epoll ep(backend);
+            int ready = eventfd(1, EFD_NONBLOCK);
+            ep.add(ready, EPOLLIN);
+            for (uint64_t k = 0; k < it; ++k) g_sink = ep.wait(events, 8, 0);
+            close(ready);
+        }},
+    };
+    for (auto &c : cases) {
+        std::string name = std::string("epoll/") + backend_name + "/" + c.op;
+        if (!selected(name)) continue;
+        uint64_t iters;
+        double ns = measure(c.body, iters);
+        printf("{\"bench\":\"%s\",\"iters\":%llu,\"ns_per_op\":%.1f}\n",
+               name.c_str(), (unsigned long long)iters, ns);
+        fflush(stdout);
+    }
+    close(efd);
+}
+
+// ---------------- Полный цикл через loopback ----------------
+
+// Сервер в том же процессе на свободном порту (keep-alive, один реактор)
+class InProcessServer {
+public:
+    InProcessServer() {
+        cfg_.keep_alive = true;
+        fd_ = make_listener(0, false);
+        sockaddr_in addr{};
+        socklen_t len = sizeof(addr);
+        getsockname(fd_, (sockaddr*)&addr, &len);
+        port_ = ntohs(addr.sin_port);
+        cfg_.port = port_;
+        thread_ = std::thread(run_reactor, fd_, 0, std::cref(cfg_), std::ref(registry_.add_reactor()),
+                              std::ref(control_), nullptr, nullptr, nullptr);
+    }
+    ~InProcessServer() {
+        control_.request_stop();
+        thread_.join();
+        close(fd_);
+    }
+    int port() const { return port_; }
+private:
+    ServerConfig cfg_;
+    MetricsRegistry registry_;
+    ReactorControl control_;
+    int fd_ = -1;
+    int port_ = 0;
+    std::thread thread_;
+};
+
+static int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sockaddr_in s{};
+    s.sin_family = AF_INET;
+    s.sin_port = htons(port);
+    s.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&s, sizeof(s)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Отправить запрос фрагментами по frag байт (0 — целиком) и дождаться ответа
+static bool round_trip(int fd, const std::string &req, size_t frag, bool one_shot) {
+    size_t step = frag ? frag : req.size();
+    for (size_t off = 0; off < req.size(); off += step) {
+        size_t len = std::min(step, req.size() - off);
+        if (send(fd, req.data() + off, len, MSG_NOSIGNAL) != (ssize_t)len) return false;
+    }
+    if (one_shot) shutdown(fd, SHUT_WR);
+    char buf[512];
+    while (true) {
+        ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r <= 0) return one_shot && r == 0;
+        if (!one_shot && memchr(buf, '\n', (size_t)r)) return true;
+    }
+}
+
+static void bench_roundtrip() {
+    if (!selected("roundtrip/keep_alive") && !selected("roundtrip/one_shot")) return;
+    InProcessServer server;
+    const int sizes[] = {5, 100, 1000};
+    const size_t frags[] = {1, 8, 64, 0};
+    for (int n : sizes) {
+        std::string e = make_expr(n, 0, 7 + n);
+        for (size_t frag : frags) {
+            for (int one_shot = 0; one_shot < 2; ++one_shot) {
+                std::string name = one_shot ? "roundtrip/one_shot" : "roundtrip/keep_alive";
+                if (!selected(name)) continue;
+                std::string req = one_shot ? e : e + "\n";
+                LatencyHistogram hist;
+                bool ok = true;
+                int fd = one_shot ? -1 : connect_loopback(server.port());
+                uint64_t iters;
+                double ns = measure([&](uint64_t it) {
+                    for (uint64_t k = 0; k < it && ok; ++k) {
+                        uint64_t t0 = now_ns();
+                        if (one_shot) {
+                            int c = connect_loopback(server.port());
+                            ok = c >= 0 && round_trip(c, req, frag, true);
+                            if (c >= 0) close(c);
+                        } else {
+                            ok = round_trip(fd, req, frag, false);
+                        }
+                        hist.record(now_ns() - t0);
+                    }
+                }, iters);
+                if (fd >= 0) close(fd);
+                std::vector<uint64_t> buckets(LatencyHistogram::kBuckets, 0);
+                hist.merge_into(buckets);
+                printf("{\"bench\":\"%s\",\"n\":%d,\"bytes\":%zu,\"fragment\":%zu,\"iters\":%llu,"
+                       "\"ns_per_op\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"ok\":%s}\n",
+                       name.c_str(), n, e.size(), frag, (unsigned long long)iters, ns,
+                       (unsigned long long)histogram_quantile(buckets, 0.5),
+                       (unsigned long long)histogram_quantile(buckets, 0.99), ok ? "true" : "false");
+                fflush(stdout);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--filter" && a + 1 < argc) g_opts.filter = argv[++a];
+        else if (arg == "--min-time-ms" && a + 1 < argc) g_opts.min_time_ms = std::stod(argv[++a]);
+        else if (arg == "--repeats" && a + 1 < argc) g_opts.repeats = std::max(1, std::stoi(argv[++a]));
+        else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--filter SUBSTR] [--min-time-ms MS] [--repeats R]\n";
+            return 1;
+        }
+    }
+    Logger::instance().set_level(LogLevel::Warn);
+    Logger::instance().start();
+    printf("{\"bench\":\"meta\",\"compiler\":\"%s\",\"optimized\":%s,\"min_time_ms\":%.0f,\"repeats\":%d}\n",
+           __VERSION__,
+#ifdef NDEBUG
+           "true",
+#else
+           "false",
+#endif
+           g_opts.min_time_ms, g_opts.repeats);
+    bench_parser();
+    bench_epoll(Epoll::Backend::Epoll, "epoll");
+    bench_epoll(Epoll::Backend::IoUring, "io_uring");
+    bench_roundtrip();
+    Logger::instance().stop();
+    return 0;
+}
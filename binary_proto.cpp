@@ -0,0 +1,52 @@
+#include "binary_proto.h"
+
+bool encode_binary_frame(std::string_view expr, std::string &out) {
+    size_t header = out.size();
+    out.append(4, '\0');
+    size_t k = 0;
+    while (k < expr.size()) {
+        char c = expr[k];
+        if (c == ' ') {
+            k += scan_spaces(expr.data() + k, expr.size() - k);
+        } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '(' || c == ')') {
+            out += c;
+            ++k;
+        } else {
+            size_t run = scan_number_chars(expr.data() + k, expr.size() - k);
+            double v;
+            if (run == 0 || !parse_number(expr.data() + k, run, v)) {
+                out.resize(header);
+                return false;
+            }
+            uint64_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            unsigned char num[9];
+            num[0] = kTokNumber;
+            store_le64(bits, num + 1);
+            out.append(reinterpret_cast<const char *>(num), sizeof(num));
+            k += run;
+        }
+    }
+    uint32_t len = uint32_t(out.size() - header - 4);
+    for (int i = 0; i < 4; ++i) out[header + i] = char(len >> (8 * i));
+    return true;
+}
+
+void encode_binary_result(bool ok, double value, char *buf) {
+    buf[0] = (char)(ok ? kStatusOk : kStatusError);
+    uint64_t bits = 0;
+    if (ok) memcpy(&bits, &value, sizeof(bits));
+    store_le64(bits, reinterpret_cast<unsigned char *>(buf) + 1);
+}
+
+void append_binary_result(std::string &out, bool ok, double value) {
+    char buf[kBinaryResultSize];
+    encode_binary_result(ok, value, buf);
+    out.append(buf, sizeof(buf));
+}
+
+bool parse_binary_result(const char *p, double &value) {
+    uint64_t bits = load_le64(reinterpret_cast<const unsigned char *>(p) + 1);
+    memcpy(&value, &bits, sizeof(value));
+    return (unsigned char)p[0] == kStatusOk;
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include "calc_core.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Двоичный протокол запросов для машинных клиентов. Соединение, первый байт
+// которого kBinaryMagic, вместо текста несёт поток кадров:
+//   длина полезной нагрузки — uint32, little-endian;
+//   токены выражения в обычном (инфиксном) порядке: kTokNumber и 8 байт
+//   IEEE-754 double (little-endian) либо один байт '+', '-', '*', '/', '(' или ')'.
+// На каждый кадр сервер отвечает kBinaryResultSize байтами: статус
+// (kStatusOk/kStatusError) и результат — double, little-endian (0 при ошибке).
+// В тексте такой байт встретиться не может, поэтому текстовые клиенты не затронуты.
+
+const unsigned char kBinaryMagic = 0xCA;
+const unsigned char kTokNumber = 0x01;
+const unsigned char kStatusOk = 0;
+const unsigned char kStatusError = 1;
+const size_t kBinaryResultSize = 9;
+
+inline uint64_t load_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+
+inline void store_le64(uint64_t v, unsigned char *p) {
+    for (int i = 0; i < 8; ++i) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+// Текстовое выражение в двоичный кадр (дописывается в out). Числа переводятся
+// так же, как их читает сервер, поэтому результат совпадает с текстовым.
+// false — в выражении есть посторонние символы или некорректное число.
+bool encode_binary_frame(std::string_view expr, std::string &out);
+
+// Ответ на кадр: kBinaryResultSize байт в buf или в конец out
+void encode_binary_result(bool ok, double value, char *buf);
+void append_binary_result(std::string &out, bool ok, double value);
+
+// Разбор ответа из kBinaryResultSize байт; false — сервер ответил ошибкой
+bool parse_binary_result(const char *p, double &value);
+
+// Потоковый разбор кадров прямо из буфера приёма: токены сразу отдаются
+// вычислителю, копируются лишь заголовки и числа, разрезанные границей фрагментов.
+class BinaryDecoder {
+public:
+    // По концу каждого кадра вызывается on_frame(ok, value), а eval сбрасывается
+    template <class OnFrame>
+    void feed(const char *data, size_t len, StreamEvaluator &eval, OnFrame on_frame);
+    void reset() {
+        state_ = State::Header;
+        have_ = 0;
+        bad_ = false;
+    }
+    bool in_frame() const { return state_ != State::Header || have_ > 0; }
+private:
+    enum class State { Header, Token, Number };
+
+    State state_ = State::Header;
+    size_t have_ = 0;         // байт заголовка или числа уже собрано в part_
+    uint32_t remaining_ = 0;  // байт полезной нагрузки до конца кадра
+    bool bad_ = false;        // кадр оборвался посреди числа
+    unsigned char part_[8];
+};
+
+template <class OnFrame>
+void BinaryDecoder::feed(const char *data, size_t len, StreamEvaluator &eval, OnFrame on_frame) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    size_t k = 0;
+    while (k < len) {
+        if (state_ == State::Header) {
+            size_t take = len - k < 4 - have_ ? len - k : 4 - have_;
+            memcpy(part_ + have_, p + k, take);
+            have_ += take;
+            k += take;
+            if (have_ < 4) return;
+            remaining_ = uint32_t(part_[0]) | uint32_t(part_[1]) << 8 |
+                         uint32_t(part_[2]) << 16 | uint32_t(part_[3]) << 24;
+            have_ = 0;
+            state_ = State::Token;
+        } else if (state_ == State::Token) {
+            unsigned char tag = p[k++];
+            --remaining_;
+            if (tag == kTokNumber) state_ = State::Number;
+            else eval.push_op((char)tag);
+        } else {
+            size_t take = 8 - have_;
+            if (take > len - k) take = len - k;
+            if (take > remaining_) take = remaining_;
+            if (have_ == 0 && take == 8) {
+                // число целиком во фрагменте — читаем на месте
+                uint64_t bits = load_le64(p + k);
+                double v;
+                memcpy(&v, &bits, sizeof(v));
+                eval.push_number(v);
+                state_ = State::Token;
+            } else {
+                memcpy(part_ + have_, p + k, take);
+                have_ += take;
+                if (have_ == 8) {
+                    uint64_t bits = load_le64(part_);
+                    double v;
+                    memcpy(&v, &bits, sizeof(v));
+                    eval.push_number(v);
+                    have_ = 0;
+                    state_ = State::Token;
+                }
+            }
+            k += take;
+            remaining_ -= (uint32_t)take;
+        }
+        if (state_ != State::Header && remaining_ == 0) {
+            if (state_ == State::Number) bad_ = true; // длина кадра не вмещает число
+            double v = 0;
+            bool ok = !bad_ && eval.finish(v);
+            eval.reset();
+            reset();
+            on_frame(ok, v);
+        }
+    }
+}
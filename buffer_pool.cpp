@@ -0,0 +1,90 @@
+#include "buffer_pool.h"
+#include <cstring>
+#include <new>
+
+BufferPool::BufferPool(size_t block_size, size_t max_free)
+    : block_size_(block_size), capacity_(block_size - sizeof(BufferBlock)), max_free_(max_free) {}
+
+BufferPool::~BufferPool() {
+    while (free_) {
+        BufferBlock *next = free_->next;
+        ::operator delete(free_);
+        free_ = next;
+    }
+}
+
+BufferBlock *BufferPool::acquire() {
+    BufferBlock *block = free_;
+    if (block) {
+        free_ = block->next;
+        --free_count_;
+    } else {
+        block = static_cast<BufferBlock *>(::operator new(block_size_));
+        ++allocated_;
+    }
+    return new (block) BufferBlock;
+}
+
+void BufferPool::release(BufferBlock *block) {
+    if (free_count_ >= max_free_) {
+        ::operator delete(block);
+        --allocated_;
+        return;
+    }
+    block->next = free_;
+    free_ = block;
+    ++free_count_;
+}
+
+void BlockChain::append(const char *data, size_t len) {
+    size_ += len;
+    while (len > 0) {
+        if (!tail_ || tail_->end == pool_->capacity()) {
+            BufferBlock *block = pool_->acquire();
+            if (tail_) tail_->next = block;
+            else head_ = block;
+            tail_ = block;
+        }
+        size_t n = pool_->capacity() - tail_->end;
+        if (n > len) n = len;
+        memcpy(tail_->data() + tail_->end, data, n);
+        tail_->end += (uint32_t)n;
+        data += n;
+        len -= n;
+    }
+}
+
+void BlockChain::consume(size_t n) {
+    if (n >= size_) {
+        clear();
+        return;
+    }
+    size_ -= n;
+    while (n > 0) {
+        size_t avail = head_->end - head_->begin;
+        if (n < avail) {
+            head_->begin += (uint32_t)n;
+            return;
+        }
+        n -= avail;
+        BufferBlock *next = head_->next;
+        pool_->release(head_);
+        head_ = next;
+    }
+}
+
+void BlockChain::clear() {
+    while (head_) {
+        BufferBlock *next = head_->next;
+        pool_->release(head_);
+        head_ = next;
+    }
+    tail_ = nullptr;
+    size_ = 0;
+}
+
+void BlockChain::copy_to(std::string &out) const {
+    out.reserve(out.size() + size_);
+    for (const BufferBlock *b = head_; b; b = b->next)
+        out.append(b->data() + b->begin, b->end - b->begin);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Блок буфера фиксированного размера; данные лежат сразу за заголовком
+struct BufferBlock {
+    BufferBlock *next = nullptr;
+    uint32_t begin = 0;   // первый непрочитанный байт
+    uint32_t end = 0;     // конец записанных данных
+    char *data() { return reinterpret_cast<char *>(this + 1); }
+    const char *data() const { return reinterpret_cast<const char *>(this + 1); }
+};
+
+// Пул блоков одного размера. Освобождённые блоки остаются в списке свободных
+// (не больше max_free), поэтому короткие соединения не трогают malloc, а
+// память буферов не дробится. Не потокобезопасен: у каждого реактора свой.
+class BufferPool {
+public:
+    BufferPool(size_t block_size, size_t max_free);
+    ~BufferPool();
+
+    BufferBlock *acquire();
+    void release(BufferBlock *block);
+    size_t capacity() const { return capacity_; }    // байт данных в блоке
+    size_t block_size() const { return block_size_; }
+    size_t allocated() const { return allocated_; }  // блоков, взятых у системы (занятые и свободные)
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+private:
+    size_t block_size_;
+    size_t capacity_;
+    size_t max_free_;
+    BufferBlock *free_ = nullptr;
+    size_t free_count_ = 0;
+    size_t allocated_ = 0;
+};
+
+// Очередь байтов из цепочки блоков пула: дописывается в конец, читается с начала.
+// Растёт блоками без перевыделения и копирования, опустевшие блоки сразу
+// возвращаются в пул, так что простаивающее соединение не держит памяти.
+class BlockChain {
+public:
+    explicit BlockChain(BufferPool &pool) : pool_(&pool) {}
+    ~BlockChain() { clear(); }
+
+    void append(const char *data, size_t len);
+    void append(char c) { append(&c, 1); }
+    // Отбросить n байт из начала
+    void consume(size_t n);
+    void clear();
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // Первый блок с данными [begin, end) для обхода и writev
+    const BufferBlock *front() const { return head_; }
+    // Дописать содержимое в out
+    void copy_to(std::string &out) const;
+
+    BlockChain(const BlockChain &) = delete;
+    BlockChain &operator=(const BlockChain &) = delete;
+private:
+    BufferPool *pool_;
+    BufferBlock *head_ = nullptr;
+    BufferBlock *tail_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,382 @@
+#include "calc_core.h"
+#include <algorithm>
+#include <cfloat>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+static inline bool is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '.';
+}
+
+static inline int precedence(char op) {
+    return (op == '*' || op == '/') ? 2 : 1;
+}
+
+// Маска символов числа в блоке: байты вне ASCII отрицательны и меньше '0'
+#if defined(__SSE2__)
+static inline unsigned number_mask16(__m128i v) {
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i dot = _mm_cmpeq_epi8(v, _mm_set1_epi8('.'));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(digit, dot));
+}
+#endif
+#if defined(__AVX2__)
+static inline unsigned number_mask32(__m256i v) {
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+    __m256i dot = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.'));
+    return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(digit, dot));
+}
+#endif
+
+size_t scan_number_chars(const char *p, size_t n) {
+    size_t k = 0;
+#if defined(__AVX2__)
+    for (; k + 32 <= n; k += 32) {
+        unsigned m = ~number_mask32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k)));
+        if (m) return k + __builtin_ctz(m);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; k + 16 <= n; k += 16) {
+        unsigned m = ~number_mask16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k))) & 0xFFFF;
+        if (m) return k + __builtin_ctz(m);
+    }
+#endif
+    while (k < n && is_number_char(p[k])) ++k;
+    return k;
+}
+
+size_t scan_spaces(const char *p, size_t n) {
+    size_t k = 0;
+#if defined(__AVX2__)
+    for (; k + 32 <= n; k += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+        unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        if (m) return k + __builtin_ctz(m);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; k + 16 <= n; k += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+        unsigned m = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' '))) & 0xFFFF;
+        if (m) return k + __builtin_ctz(m);
+    }
+#endif
+    while (k < n && p[k] == ' ') ++k;
+    return k;
+}
+
+bool parse_number(const char *first, size_t len, double &value) {
+    // целое до 15 цифр представимо точно: тот же результат, что у from_chars, в разы быстрее
+    if (len > 0 && len <= 15) {
+        uint64_t v = 0;
+        size_t k = 0;
+        for (; k < len; ++k) {
+            unsigned d = unsigned(first[k] - '0');
+            if (d > 9) break;
+            v = v * 10 + d;
+        }
+        if (k == len) {
+            value = double(v);
+            return true;
+        }
+    }
+    auto res = std::from_chars(first, first + len, value);
+    if (res.ec != std::errc() || res.ptr == first) return false;
+    // std::stod (через strtod) считает ошибкой и потерю значимости: результат
+    // субнормален или ненулевое число округлилось до нуля
+    if (value != 0) return std::fabs(value) >= DBL_MIN;
+    for (const char *p = first; p != res.ptr; ++p)
+        if (*p >= '1' && *p <= '9') return false;
+    return true;
+}
+
+size_t format_result(double value, char *buf) {
+    auto res = std::to_chars(buf, buf + kResultBufSize, value, std::chars_format::fixed, 6);
+    return size_t(res.ptr - buf);
+}
+
+bool split_top_level(std::string_view expr, std::vector<std::string_view> &terms,
+                     std::vector<char> &ops) {
+    terms.clear();
+    ops.clear();
+    size_t depth = 0, start = 0;
+    for (size_t k = 0; k < expr.size(); ++k) {
+        char c = expr[k];
+        if (c == '(') ++depth;
+        else if (c == ')') {
+            if (depth == 0) return false;
+            --depth;
+        }
+        else if ((c == '+' || c == '-') && depth == 0) {
+            terms.push_back(expr.substr(start, k - start));
+            ops.push_back(c);
+            start = k + 1;
+        }
+    }
+    if (depth != 0) return false;
+    terms.push_back(expr.substr(start));
+    return true;
+}
+
+// ---------------- Скомпилированные выражения ----------------
+
+bool tokenize_expr(std::string_view expr, std::string &shape, std::vector<double> &consts) {
+    consts.clear();
+    // форма не длиннее текста: пишем в заранее выделенную строку без проверок ёмкости
+    shape.resize(expr.size());
+    char *out = &shape[0];
+    const char *p = expr.data();
+    size_t n = expr.size(), k = 0;
+    bool ok = true;
+    while (k < n) {
+        char c = p[k];
+        if (c == ' ') {
+            // между токенами обычно один пробел: векторный сканер — только для серий
+            k += k + 1 < n && p[k + 1] == ' ' ? scan_spaces(p + k, n - k) : 1;
+        } else if (is_number_char(c)) {
+            size_t run = scan_number_chars(p + k, n - k);
+            double v;
+            if (!parse_number(p + k, run, v)) { ok = false; break; }
+            consts.push_back(v);
+            *out++ = 'n';
+            k += run;
+        } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '(' || c == ')') {
+            *out++ = c;
+            ++k;
+        } else {
+            ok = false;
+            break;
+        }
+    }
+    shape.resize(size_t(out - shape.data()));
+    return ok;
+}
+
+static inline uint8_t opcode(char op) {
+    switch (op) {
+        case '+': return ExprProgram::Add;
+        case '-': return ExprProgram::Sub;
+        case '*': return ExprProgram::Mul;
+        default: return ExprProgram::Div;
+    }
+}
+
+// Та же грамматика и ассоциативность, что у StreamEvaluator::step
+bool ExprProgram::compile(std::string_view shape) {
+    code.clear();
+    depth = 0;
+    std::vector<char> ops;
+    size_t cur = 0;
+    bool expect_operand = true;
+    for (char c : shape) {
+        if (expect_operand) {
+            if (c == 'n') {
+                code.push_back(Push);
+                depth = std::max(depth, ++cur);
+                expect_operand = false;
+            } else if (c == '(') {
+                ops.push_back(c);
+            } else {
+                return false;
+            }
+        } else if (c == ')') {
+            while (!ops.empty() && ops.back() != '(') {
+                code.push_back(opcode(ops.back()));
+                ops.pop_back();
+                --cur;
+            }
+            if (ops.empty()) return false;
+            ops.pop_back();
+        } else if (c == '+' || c == '-' || c == '*' || c == '/') {
+            while (!ops.empty() && ops.back() != '(' && precedence(ops.back()) >= precedence(c)) {
+                code.push_back(opcode(ops.back()));
+                ops.pop_back();
+                --cur;
+            }
+            ops.push_back(c);
+            expect_operand = true;
+        } else {
+            return false;
+        }
+    }
+    if (expect_operand) return false;
+    while (!ops.empty()) {
+        if (ops.back() == '(') return false;
+        code.push_back(opcode(ops.back()));
+        ops.pop_back();
+    }
+    return true;
+}
+
+bool ExprProgram::run(const double *consts, std::vector<double> &stack, double &result) const {
+    if (stack.size() < depth) stack.resize(depth);
+    double *sp = stack.data();
+    for (uint8_t op : code) {
+        switch (op) {
+            case Push: *sp++ = *consts++; break;
+            case Add: --sp; sp[-1] += *sp; break;
+            case Sub: --sp; sp[-1] -= *sp; break;
+            case Mul: --sp; sp[-1] *= *sp; break;
+            default:
+                --sp;
+                if (*sp == 0) return false;
+                sp[-1] /= *sp;
+        }
+    }
+    result = stack[0];
+    return true;
+}
+
+bool ExprCompiler::evaluate(std::string_view expr, double &result) {
+    if (!tokenize_expr(expr, shape_, consts_)) return false;
+    if (shape_.size() > kMaxShapeLen) {
+        // длинная форма почти наверняка уникальна: компиляция не окупится,
+        // токены сразу сворачивает потоковый вычислитель
+        const double *k = consts_.data();
+        stream_.reset();
+        for (char c : shape_) {
+            if (c == 'n') stream_.push_number(*k++);
+            else stream_.push_op(c);
+        }
+        return stream_.finish(result);
+    }
+    auto it = shapes_.find(shape_);
+    if (it == shapes_.end()) {
+        // форм в потоке обычно немного; при переполнении кэш просто начинается заново
+        if (shapes_.size() >= max_shapes_) shapes_.clear();
+        it = shapes_.emplace(shape_, ExprProgram()).first;
+        // некорректная форма тоже запоминается: пустой программой
+        if (!it->second.compile(shape_)) it->second.code.clear();
+    }
+    const ExprProgram &prog = it->second;
+    if (prog.code.empty()) return false;
+    return prog.run(consts_.data(), stack_, result);
+}
+
+// ---------------- ExprParser ----------------
+
+double ExprParser::parse() {
+    thread_local ExprCompiler compiler;
+    double v;
+    if (!compiler.evaluate(s, v)) throw std::runtime_error("Invalid expression or division by zero");
+    return v;
+}
+
+// ---------------- StreamEvaluator ----------------
+
+void StreamEvaluator::feed(const char *data, size_t len) {
+    size_t k = 0;
+    while (k < len && !error_) {
+        if (state_ == State::InNumber) {
+            // продолжение числа из предыдущего фрагмента
+            size_t run = scan_number_chars(data + k, len - k);
+            num_.append(data + k, run);
+            k += run;
+            if (k == len) return;
+            endNumber(num_.data(), num_.size());
+            num_.clear();
+            continue;
+        }
+        char c = data[k];
+        if (c == ' ') {
+            k += scan_spaces(data + k, len - k);
+        } else if (state_ == State::ExpectOperand && is_number_char(c)) {
+            size_t run = scan_number_chars(data + k, len - k);
+            if (k + run < len) {
+                endNumber(data + k, run); // число целиком внутри фрагмента — без копирования
+            } else {
+                num_.assign(data + k, run);
+                state_ = State::InNumber;
+            }
+            k += run;
+        } else {
+            step(c);
+            ++k;
+        }
+    }
+}
+
+bool StreamEvaluator::finish(double &result) {
+    if (state_ == State::InNumber) {
+        endNumber(num_.data(), num_.size());
+        num_.clear();
+    }
+    if (!error_ && state_ != State::ExpectOperator) error_ = true;
+    while (!error_ && !ops_.empty()) {
+        if (ops_.back() == '(') { error_ = true; break; } // ')' expected
+        reduce();
+    }
+    if (error_) return false;
+    result = values_.back();
+    return true;
+}
+
+void StreamEvaluator::push_number(double v) {
+    if (error_) return;
+    if (state_ != State::ExpectOperand) { error_ = true; return; } // два числа подряд
+    values_.push_back(v);
+    state_ = State::ExpectOperator;
+}
+
+void StreamEvaluator::reset() {
+    state_ = State::ExpectOperand;
+    error_ = false;
+    num_.clear();
+    values_.clear();
+    ops_.clear();
+}
+
+// Оператор или скобка (числа и пробелы обрабатывает feed)
+void StreamEvaluator::step(char c) {
+    if (state_ == State::ExpectOperand) {
+        if (c == '(') ops_.push_back('(');
+        else error_ = true; // Number expected
+        return;
+    }
+    // ExpectOperator: после операнда допустимы только оператор или ')'
+    if (c == '+' || c == '-' || c == '*' || c == '/') {
+        while (!error_ && !ops_.empty() && ops_.back() != '(' &&
+               precedence(ops_.back()) >= precedence(c))
+            reduce();
+        ops_.push_back(c);
+        state_ = State::ExpectOperand;
+    } else if (c == ')') {
+        while (!error_ && !ops_.empty() && ops_.back() != '(') reduce();
+        if (error_) return;
+        if (ops_.empty()) { error_ = true; return; } // лишняя ')'
+        ops_.pop_back();
+    } else {
+        error_ = true; // Unexpected chars
+    }
+}
+
+void StreamEvaluator::endNumber(const char *first, size_t len) {
+    double v = 0;
+    if (!parse_number(first, len, v)) error_ = true;
+    values_.push_back(v);
+    state_ = State::ExpectOperator;
+}
+
+void StreamEvaluator::reduce() {
+    char op = ops_.back();
+    ops_.pop_back();
+    double rhs = values_.back();
+    values_.pop_back();
+    double &lhs = values_.back();
+    switch (op) {
+        case '+': lhs += rhs; break;
+        case '-': lhs -= rhs; break;
+        case '*': lhs *= rhs; break;
+        default:
+            if (rhs == 0) { error_ = true; return; } // Division by zero
+            lhs /= rhs;
+    }
+}
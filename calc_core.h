@@ -0,0 +1,117 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Общее ядро калькулятора для сервера и клиента: разбор и вычисление
+// выражений без выделения памяти на каждый токен.
+
+// Векторный сканер символов (SSE2/AVX2, иначе побайтно).
+// Возвращают длину префикса из символов числа ([0-9.]) и из пробелов.
+size_t scan_number_chars(const char *p, size_t n);
+size_t scan_spaces(const char *p, size_t n);
+
+// Перевод числа из [first, first+len) так же, как это делал std::stod:
+// берётся самый длинный корректный префикс; false — числа нет или оно вне диапазона
+bool parse_number(const char *first, size_t len, double &value);
+
+// Буфер, гарантированно вмещающий любой результат format_result
+const size_t kResultBufSize = 512;
+
+// Форматирование результата в том же виде, что std::to_string(double) ("%f"),
+// но без выделения памяти. Возвращает число записанных символов.
+size_t format_result(double value, char *buf);
+
+// Разбиение выражения по '+' и '-' вне скобок: terms[k] — k-е слагаемое,
+// ops[k-1] — знак перед ним. Каждое слагаемое — самостоятельное выражение без
+// сложения на верхнем уровне. false — скобки не сбалансированы.
+bool split_top_level(std::string_view expr, std::vector<std::string_view> &terms,
+                     std::vector<char> &ops);
+
+// Разбор текста на форму и константы. Форма — выражение без пробелов, где каждое
+// число заменено на 'n': "(1 + 2) * 3" -> "(n+n)*n"; константы — числа по порядку.
+// Выражения с одной формой отличаются только константами. false — недопустимый
+// символ или число (синтаксис формы проверяет ExprProgram::compile).
+bool tokenize_expr(std::string_view expr, std::string &shape, std::vector<double> &consts);
+
+// Выражение, сведённое к постфиксному байткоду. Операнды в постфиксной записи идут
+// в том же порядке, что и в тексте, поэтому программа зависит только от формы,
+// а константы подставляются при запуске. Вычисление — цикл по стеку значений без
+// рекурсии, так что глубина скобок ограничена только памятью.
+struct ExprProgram {
+    enum Op : uint8_t { Push, Add, Sub, Mul, Div };
+    std::vector<uint8_t> code; // Push берёт следующую константу
+    size_t depth = 0;          // наибольшая глубина стека значений
+
+    // Перевод формы (сортировочная станция); false — выражение некорректно
+    bool compile(std::string_view shape);
+    // Выполнить на константах формы; stack — рабочая память. false — деление на ноль
+    bool run(const double *consts, std::vector<double> &stack, double &result) const;
+};
+
+// Потоковый вычислитель с учётом приоритета операций (алгоритм сортировочной
+// станции). Получает выражение фрагментами по мере прихода из сокета и сразу
+// сворачивает всё, что можно свернуть, поэтому хранит лишь O(глубина скобок)
+// состояния. Результат совпадает с ExprParser: та же грамматика,
+// та же левая ассоциативность и тот же порядок операций.
+class StreamEvaluator {
+public:
+    // Обработать очередной фрагмент выражения
+    void feed(const char *data, size_t len);
+    // Завершить выражение; false — выражение некорректно
+    bool finish(double &result);
+    // Подготовить вычислитель к следующему выражению (память не освобождается)
+    void reset();
+    bool failed() const { return error_; }
+    // Уже разобранные токены (двоичный протокол): число и оператор или скобка
+    void push_number(double v);
+    void push_op(char c) {
+        if (!error_) step(c);
+    }
+private:
+    enum class State { ExpectOperand, InNumber, ExpectOperator };
+
+    void step(char c);
+    void endNumber(const char *first, size_t len);
+    void reduce();
+
+    State state_ = State::ExpectOperand;
+    bool error_ = false;
+    std::string num_;           // число, разрезанное границей фрагментов
+    std::vector<double> values_;
+    std::vector<char> ops_;     // '(' и ещё не применённые операторы
+};
+
+// Вычисление через кэш скомпилированных форм: выражение разбирается на форму и
+// константы, а байткод берётся готовым, если такая форма уже встречалась.
+// Длинные формы почти не повторяются, их токены сворачивает StreamEvaluator.
+// Не потокобезопасен: по экземпляру на поток.
+class ExprCompiler {
+public:
+    ExprCompiler() = default;
+    explicit ExprCompiler(size_t max_shapes) : max_shapes_(max_shapes) {}
+    // false — выражение некорректно или делит на ноль
+    bool evaluate(std::string_view expr, double &result);
+private:
+    static const size_t kMaxShapeLen = 256;
+
+    size_t max_shapes_ = 1024;
+    std::unordered_map<std::string, ExprProgram> shapes_;
+    std::string shape_;
+    std::vector<double> consts_;
+    std::vector<double> stack_;
+    StreamEvaluator stream_;   // для длинных форм
+};
+
+// Разбор и вычисление выражения целиком с учётом приоритета операций (через
+// ExprCompiler потока). Бросает std::runtime_error на некорректном выражении
+// и делении на ноль.
+class ExprParser {
+    std::string_view s;
+public:
+    explicit ExprParser(std::string_view str) : s(str) {}
+    double parse();
+};
@@ -0,0 +1,315 @@
+// Дифференциальная проверка вычислителей calc_core: StreamEvaluator (целиком и
+// случайными фрагментами), ExprCompiler и ExprProgram сравниваются с эталоном —
+// рекурсивным спуском поверх strtod, не разделяющим с ними ни строчки кода.
+// Выражения случайные, но воспроизводимые: генератор с фиксированным зерном.
+#include "calc_core.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static int g_failures = 0;
+static size_t g_checked = 0;
+
+// Результат вычисления: ok == false — ошибка (синтаксис, число, деление на ноль)
+struct Outcome {
+    bool ok = false;
+    double value = 0;
+};
+
+static bool same(const Outcome &a, const Outcome &b) {
+    if (a.ok != b.ok) return false;
+    if (!a.ok) return true;
+    if (std::isnan(a.value) || std::isnan(b.value)) return std::isnan(a.value) && std::isnan(b.value);
+    return memcmp(&a.value, &b.value, sizeof(double)) == 0; // побитно, включая знак нуля
+}
+
+static std::string show(const Outcome &o) {
+    if (!o.ok) return "ERROR";
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.17g", o.value);
+    return buf;
+}
+
+static void report(const char *impl, const std::string &expr, const Outcome &got, const Outcome &want) {
+    if (++g_failures > 20) return;
+    std::string head = expr.size() > 160 ? expr.substr(0, 160) + "..." : expr;
+    fprintf(stderr, "FAIL %s: '%s' (%zu bytes): got %s, expected %s\n", impl, head.c_str(), expr.size(),
+            show(got).c_str(), show(want).c_str());
+}
+
+// ---------------- Эталон ----------------
+
+// Грамматика сервера: expr = term {('+'|'-') term}, term = factor {('*'|'/') factor},
+// factor = number | '(' expr ')'; между токенами — пробелы. Число — серия [0-9.],
+// переводится как std::stod: самый длинный корректный префикс, вне диапазона
+// (включая потерю значимости) — ошибка.
+class Reference {
+public:
+    explicit Reference(std::string_view s) : s_(s) {}
+
+    Outcome eval() {
+        Outcome out;
+        double v = expr();
+        skip();
+        out.ok = ok_ && pos_ == s_.size();
+        out.value = v;
+        return out;
+    }
+private:
+    void skip() {
+        while (pos_ < s_.size() && s_[pos_] == ' ') ++pos_;
+    }
+    bool at(char c) {
+        skip();
+        return pos_ < s_.size() && s_[pos_] == c;
+    }
+    double expr() {
+        double v = term();
+        while (ok_ && (at('+') || at('-'))) {
+            char op = s_[pos_++];
+            double r = term();
+            v = op == '+' ? v + r : v - r;
+        }
+        return v;
+    }
+    double term() {
+        double v = factor();
+        while (ok_ && (at('*') || at('/'))) {
+            char op = s_[pos_++];
+            double r = factor();
+            if (op == '*') {
+                v *= r;
+            } else if (r == 0) {
+                ok_ = false;
+            } else {
+                v /= r;
+            }
+        }
+        return v;
+    }
+    double factor() {
+        if (at('(')) {
+            ++pos_;
+            double v = expr();
+            if (at(')')) ++pos_;
+            else ok_ = false;
+            return v;
+        }
+        size_t start = pos_;
+        while (pos_ < s_.size() && ((s_[pos_] >= '0' && s_[pos_] <= '9') || s_[pos_] == '.')) ++pos_;
+        std::string run(s_.substr(start, pos_ - start));
+        char *end = nullptr;
+        errno = 0;
+        double v = strtod(run.c_str(), &end);
+        if (run.empty() || end == run.c_str() || errno == ERANGE) ok_ = false;
+        return v;
+    }
+
+    std::string_view s_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+// ---------------- Проверяемые реализации ----------------
+
+static Outcome run_stream(StreamEvaluator &ev, const std::string &expr, std::mt19937_64 &rng, size_t max_frag) {
+    ev.reset();
+    size_t off = 0;
+    while (off < expr.size()) {
+        size_t len = max_frag ? 1 + rng() % max_frag : expr.size() - off;
+        len = std::min(len, expr.size() - off);
+        ev.feed(expr.data() + off, len);
+        off += len;
+    }
+    Outcome out;
+    out.ok = ev.finish(out.value);
+    return out;
+}
+
+static Outcome run_program(const std::string &expr) {
+    std::string shape;
+    std::vector<double> consts, stack;
+    ExprProgram prog;
+    Outcome out;
+    out.ok = tokenize_expr(expr, shape, consts) && prog.compile(shape) && prog.run(consts.data(), stack, out.value);
+    return out;
+}
+
+static Outcome run_compiler(ExprCompiler &comp, const std::string &expr) {
+    Outcome out;
+    out.ok = comp.evaluate(expr, out.value);
+    return out;
+}
+
+struct Impls {
+    StreamEvaluator stream;
+    ExprCompiler compiler;          // кэш по умолчанию
+    ExprCompiler small_compiler{4}; // кэш постоянно переполняется и сбрасывается
+};
+
+// Все реализации против ожидаемого результата
+static void check_against(Impls &impls, const std::string &expr, const Outcome &want, std::mt19937_64 &rng,
+                          bool with_program = true) {
+    ++g_checked;
+    Outcome got = run_stream(impls.stream, expr, rng, 0);
+    if (!same(got, want)) report("StreamEvaluator", expr, got, want);
+    got = run_stream(impls.stream, expr, rng, 1);
+    if (!same(got, want)) report("StreamEvaluator/1", expr, got, want);
+    got = run_stream(impls.stream, expr, rng, 17);
+    if (!same(got, want)) report("StreamEvaluator/frag", expr, got, want);
+    got = run_compiler(impls.compiler, expr);
+    if (!same(got, want)) report("ExprCompiler", expr, got, want);
+    got = run_compiler(impls.small_compiler, expr);
+    if (!same(got, want)) report("ExprCompiler(4)", expr, got, want);
+    if (with_program) {
+        got = run_program(expr);
+        if (!same(got, want)) report("ExprProgram", expr, got, want);
+    }
+}
+
+static void check(Impls &impls, const std::string &expr, std::mt19937_64 &rng) {
+    check_against(impls, expr, Reference(expr).eval(), rng);
+}
+
+// ---------------- Генератор выражений ----------------
+
+// Нуль (деление на ноль) — раз в odd_one_in чисел, крайние и некорректные числа —
+// вдесятеро реже: иначе почти каждое длинное выражение было бы ошибкой или inf
+static std::string random_number(std::mt19937_64 &rng, unsigned odd_one_in) {
+    if (rng() % odd_one_in == 0) return rng() % 2 ? "0" : "0.000";
+    if (rng() % (odd_one_in * 10) == 0) {
+        switch (rng() % 5) {
+        case 0: return "1" + std::string(300 + rng() % 20, '0');                          // около DBL_MAX
+        case 1: return "0." + std::string(300 + rng() % 30, '0') + std::to_string(1 + rng() % 9); // почти ноль
+        case 2: return "0." + std::string(400, '0') + "1";                                // потеря значимости
+        case 3: return "1" + std::string(400, '0');                                       // переполнение
+        default: return ".";
+        }
+    }
+    switch (rng() % 10) {
+    case 0: return std::to_string(rng() % 10) + "." + std::to_string(rng() % 1000);
+    case 1: return "." + std::to_string(1 + rng() % 99);
+    case 2: return std::to_string(1 + rng() % 99) + ".";
+    case 3: return std::to_string(rng() % 100000000000000000ULL) + std::to_string(rng() % 1000); // > 15 цифр
+    case 4: return "1.2.3";
+    default: return std::to_string(1 + rng() % 999);
+    }
+}
+
+static void spaces(std::string &out, std::mt19937_64 &rng) {
+    size_t n = rng() % 8 == 0 ? rng() % 40 : rng() % 3; // изредка серия для векторного сканера
+    out.append(n, ' ');
+}
+
+static std::string random_expr(std::mt19937_64 &rng, size_t terms, size_t max_depth, unsigned odd_one_in) {
+    static const char ops[] = {'+', '-', '*', '/'};
+    std::string out;
+    size_t open = 0;
+    for (size_t i = 0; i < terms; ++i) {
+        spaces(out, rng);
+        while (open < max_depth && rng() % 3 == 0) {
+            out += '(';
+            ++open;
+            spaces(out, rng);
+        }
+        out += random_number(rng, odd_one_in);
+        spaces(out, rng);
+        while (open > 0 && rng() % 3 == 0) {
+            out += ')';
+            --open;
+            spaces(out, rng);
+        }
+        if (i + 1 < terms) out += ops[rng() % 4];
+    }
+    while (open-- > 0) out += ')';
+    // часть выражений портится: лишний или потерянный символ
+    if (!out.empty() && rng() % 5 == 0) {
+        static const char junk[] = "()+-*/ .x\n0";
+        size_t at = rng() % out.size();
+        if (rng() % 2) out.insert(out.begin() + at, junk[rng() % (sizeof(junk) - 1)]);
+        else out.erase(at, 1);
+    }
+    return out;
+}
+
+// Те же числа другими цифрами: форма не меняется, и ExprCompiler берёт её из кэша
+static std::string redigit(const std::string &expr, std::mt19937_64 &rng) {
+    std::string out = expr;
+    for (char &c : out)
+        if (c >= '0' && c <= '9') c = char('1' + rng() % 9);
+    return out;
+}
+
+// ---------------- Наборы проверок ----------------
+
+static void check_random(Impls &impls, std::mt19937_64 &rng) {
+    for (int i = 0; i < 20000; ++i) {
+        // в основном короткие формы (через кэш), иногда длиннее 256 байт (поток токенов)
+        bool long_shape = rng() % 10 == 0;
+        size_t terms = long_shape ? 100 + rng() % 200 : 1 + rng() % 8;
+        std::string e = random_expr(rng, terms, rng() % 4 == 0 ? 64 : 4, long_shape ? 2000 : 6);
+        check(impls, e, rng);
+        check(impls, redigit(e, rng), rng);
+    }
+}
+
+static void check_fixed(Impls &impls, std::mt19937_64 &rng) {
+    const std::string tiny = "0." + std::string(400, '0') + "1";
+    const std::string dbl_min = "0." + std::string(307, '0') + "22250738585072014";
+    const std::string huge = "1" + std::string(400, '0');
+    const std::string near_max = "1" + std::string(308, '0');
+    const char *exprs[] = {
+        "1 / 0", "1 / (2 - 2)", "0 / 0", "1 / 0.000", "(1 / 0) + ", "2 * (3 / (1 - 1))", "1 - 1 / 0 * 5",
+        "1", " 1 ", "((1))", "1 +", "+ 1", "()", "(1", "1)", "1 2", "1 (2)", "1.2.3 + 1", ". + 1", "",
+        "  ", "2 - 3 - 4", "16 / 4 / 2", "2 + 3 * 4 - 6 / 2", "(2 + 3) * (4 - 6) / 2",
+    };
+    for (const char *e : exprs) check(impls, e, rng);
+    for (const std::string &e : {tiny, tiny + " + 1", dbl_min, dbl_min + " * 2", huge, huge + " - 1", near_max,
+                                 near_max + " * 10", near_max + " * 10 - " + near_max + " * 10",
+                                 "0." + std::string(400, '0')})
+        check(impls, e, rng);
+}
+
+// Длинная форма целиком из одной вложенности: (1+(1+(...(1)...)))
+static std::string nested_sum(size_t depth) {
+    std::string e;
+    for (size_t i = 0; i < depth; ++i) e += "(1+";
+    e += "1";
+    e.append(depth, ')');
+    return e;
+}
+
+static void check_deep(Impls &impls, std::mt19937_64 &rng) {
+    // умеренная глубина — ещё по силам рекурсивному эталону
+    for (size_t depth : {255, 256, 257, 2000}) {
+        check(impls, std::string(depth, '(') + "7" + std::string(depth, ')'), rng);
+        check(impls, nested_sum(depth), rng);
+        check(impls, std::string(depth, '(') + "7" + std::string(depth - 1, ')'), rng);
+    }
+    // огромная — только с известным ответом: ни у одной реализации нет рекурсии
+    const size_t kDeep = 200000;
+    Outcome seven{true, 7};
+    check_against(impls, std::string(kDeep, '(') + "7" + std::string(kDeep, ')'), seven, rng);
+    check_against(impls, nested_sum(kDeep), Outcome{true, double(kDeep + 1)}, rng);
+    check_against(impls, std::string(kDeep, '(') + "7" + std::string(kDeep - 1, ')'), Outcome{}, rng);
+}
+
+int main() {
+    std::mt19937_64 rng(20240611);
+    Impls impls;
+    check_fixed(impls, rng);
+    check_deep(impls, rng);
+    check_random(impls, rng);
+    if (g_failures) {
+        fprintf(stderr, "calc_core_test: %d mismatch(es) in %zu expressions\n", g_failures, g_checked);
+        return 1;
+    }
+    printf("calc_core_test: %zu expressions, all implementations agree\n", g_checked);
+    return 0;
+}
@@ -0,0 +1,237 @@
+#include "capture.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <unistd.h>
+
+static const char *kind_key(CaptureEvent::Kind kind) {
+    switch (kind) {
+    case CaptureEvent::Start: return "start";
+    case CaptureEvent::Open: return "open";
+    case CaptureEvent::In: return "in";
+    case CaptureEvent::Out: return "out";
+    case CaptureEvent::Eof: return "eof";
+    }
+    return "";
+}
+
+void append_capture_event(std::string &out, CaptureEvent::Kind kind, uint64_t t, uint64_t conn,
+                          const char *data, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    char head[64];
+    int n = snprintf(head, sizeof(head), "{\"t\":%llu,\"c\":%llu,\"%s\":",
+                     (unsigned long long)t, (unsigned long long)conn, kind_key(kind));
+    out.append(head, (size_t)n);
+    if (kind != CaptureEvent::In && kind != CaptureEvent::Out) {
+        out += "1}\n";
+        return;
+    }
+    out += '"';
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += (char)c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c >= 0x20 && c < 0x7f) {
+            out += (char)c;
+        } else {
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            out.append(esc, sizeof(esc));
+        }
+    }
+    out += "\"}\n";
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Строка JSON с позиции pos (на открывающей кавычке); символы выше U+00FF не допускаются
+static bool parse_string(std::string_view s, size_t &pos, std::string &out) {
+    out.clear();
+    for (++pos; pos < s.size(); ++pos) {
+        char c = s[pos];
+        if (c == '"') {
+            ++pos;
+            return true;
+        }
+        if (c != '\\') {
+            out += c;
+            continue;
+        }
+        if (++pos >= s.size()) return false;
+        switch (s[pos]) {
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case '"': out += '"'; break;
+        case '\\': out += '\\'; break;
+        case '/': out += '/'; break;
+        case 'u': {
+            if (pos + 4 >= s.size()) return false;
+            int v = 0;
+            for (int k = 1; k <= 4; ++k) {
+                int d = hex_digit(s[pos + k]);
+                if (d < 0) return false;
+                v = v * 16 + d;
+            }
+            if (v > 0xff) return false;
+            out += (char)v;
+            pos += 4;
+            break;
+        }
+        default: return false;
+        }
+    }
+    return false;
+}
+
+bool parse_capture_event(std::string_view line, CaptureEvent &ev) {
+    size_t pos = line.find('{');
+    if (pos == std::string_view::npos) return false;
+    bool have_kind = false, have_t = false, have_c = false;
+    std::string key;
+    ++pos;
+    while (pos < line.size()) {
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == ',')) ++pos;
+        if (pos < line.size() && line[pos] == '}') break;
+        if (pos >= line.size() || line[pos] != '"' || !parse_string(line, pos, key)) return false;
+        while (pos < line.size() && line[pos] == ' ') ++pos;
+        if (pos >= line.size() || line[pos] != ':') return false;
+        ++pos;
+        while (pos < line.size() && line[pos] == ' ') ++pos;
+        if (pos >= line.size()) return false;
+        if (line[pos] == '"') {
+            if (key != "in" && key != "out") return false;
+            if (!parse_string(line, pos, ev.data)) return false;
+            ev.kind = key == "in" ? CaptureEvent::In : CaptureEvent::Out;
+            have_kind = true;
+            continue;
+        }
+        uint64_t v = 0;
+        size_t start = pos;
+        while (pos < line.size() && line[pos] >= '0' && line[pos] <= '9') v = v * 10 + uint64_t(line[pos++] - '0');
+        if (pos == start) return false;
+        if (key == "t") { ev.t = v; have_t = true; }
+        else if (key == "c") { ev.conn = v; have_c = true; }
+        else if (key == "open") { ev.kind = CaptureEvent::Open; have_kind = true; }
+        else if (key == "eof") { ev.kind = CaptureEvent::Eof; have_kind = true; }
+        else if (key == "start") { ev.kind = CaptureEvent::Start; ev.epoch = v; have_kind = true; }
+        // прочие числовые поля пропускаются: формат можно расширять
+    }
+    if (ev.kind != CaptureEvent::In && ev.kind != CaptureEvent::Out) ev.data.clear();
+    return have_kind && have_t && have_c;
+}
+
+std::vector<CaptureEvent> load_capture(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    std::vector<CaptureEvent> events;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (line.empty()) continue;
+        CaptureEvent ev;
+        // строка без '\n' в конце файла — запись оборвалась вместе с сервером
+        if (in.eof() && !parse_capture_event(line, ev)) break;
+        if (!parse_capture_event(line, ev))
+            throw std::runtime_error(path + ":" + std::to_string(line_no) + ": malformed capture event");
+        events.push_back(std::move(ev));
+    }
+    return events;
+}
+
+// Номер прогона — pid процесса: одновременно пишущие в файл процессы (старый
+// и новый при --handoff) различаются, а pid_max не больше 2^22
+CaptureFile::CaptureFile(const std::string &path, uint64_t start_ns)
+    : fd_(open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)), start_ns_(start_ns),
+      run_base_((uint64_t)getpid() << kCaptureRunShift) {
+    if (fd_ < 0) throw std::runtime_error("cannot open " + path + ": " + strerror(errno));
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    char line[96];
+    int n = snprintf(line, sizeof(line), "{\"t\":0,\"c\":%llu,\"start\":%llu}\n", (unsigned long long)run_base_,
+                     (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec);
+    write(std::string(line, (size_t)n));
+    writer_ = std::thread(&CaptureFile::write_loop, this);
+}
+
+CaptureFile::~CaptureFile() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    ready_.notify_one();
+    writer_.join();
+    close(fd_);
+}
+
+void CaptureFile::submit(std::string &lines) {
+    if (lines.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queued_bytes_ + lines.size() > kMaxQueuedBytes) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            lines.clear();
+            return;
+        }
+        queued_bytes_ += lines.size();
+        queue_.push_back(std::move(lines));
+        lines.clear();
+        if (!spare_.empty()) {
+            lines.swap(spare_.back());
+            spare_.pop_back();
+        }
+    }
+    ready_.notify_one();
+}
+
+void CaptureFile::write_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        ready_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return; // stop_ и всё записано
+        std::string lines = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        write(lines);
+        size_t written = lines.size();
+        lines.clear();
+        lock.lock();
+        queued_bytes_ -= written;
+        if (spare_.size() < kMaxSpare) spare_.push_back(std::move(lines));
+    }
+}
+
+void CaptureFile::write(const std::string &lines) {
+    size_t off = 0;
+    while (off < lines.size()) {
+        ssize_t w = ::write(fd_, lines.data() + off, lines.size() - off);
+        if (w <= 0) {
+            if (w < 0 && errno == EINTR) continue;
+            return; // диск полон или файл недоступен: запись теряется, сервер продолжает работать
+        }
+        off += (size_t)w;
+    }
+}
+
+void CaptureBuffer::record(CaptureEvent::Kind kind, uint64_t now_ns, uint64_t conn,
+                           const char *data, size_t len) {
+    uint64_t t = now_ns > file_.start_ns() ? now_ns - file_.start_ns() : 0;
+    conn &= (1ULL << kCaptureRunShift) - 1;
+    append_capture_event(buf_, kind, t, file_.run_base() | conn, data, len);
+}
+
+void CaptureBuffer::flush() {
+    file_.submit(buf_);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Запись трафика сервера для повторного воспроизведения (calc_server --record,
+// calc_client --replay). Формат — JSON Lines, одно событие на строку:
+//   {"t":0,"c":R,"start":E}              начало прогона: E — наносекунды от 1970
+//   {"t":1200,"c":R+7,"open":1}          соединение принято
+//   {"t":1500,"c":R+7,"in":"1 + 2\n"}    фрагмент, прочитанный одним вызовом чтения
+//   {"t":1900,"c":R+7,"out":"3.000000\n"} ответ, поставленный в очередь отправки
+//   {"t":2400,"c":R+7,"eof":1}           клиент завершил передачу
+// t — наносекунды от начала прогона, c — номер соединения; его старшие биты
+// (R = номер прогона << kCaptureRunShift) отличают прогоны, дописанные в один
+// файл разными процессами. Строки несут байты как есть: символ U+00XX — байт
+// 0xXX, поэтому двоичный протокол записывается так же. Строки разных реакторов
+// и процессов перемежаются, порядок внутри соединения сохраняется.
+
+struct CaptureEvent {
+    enum Kind { Start, Open, In, Out, Eof };
+    Kind kind = Open;
+    uint64_t t = 0;
+    uint64_t conn = 0;
+    uint64_t epoch = 0; // для Start: начало прогона, наносекунды от 1970
+    std::string data;   // байты для In и Out
+};
+
+const unsigned kCaptureRunShift = 40;
+// Прогон, к которому относится номер соединения (0 — запись без заголовка)
+inline uint64_t capture_run(uint64_t conn) { return conn >> kCaptureRunShift; }
+
+// Событие строкой JSON (с '\n') в конец out
+void append_capture_event(std::string &out, CaptureEvent::Kind kind, uint64_t t, uint64_t conn,
+                          const char *data = nullptr, size_t len = 0);
+// Разбор одной строки; false — строка не в этом формате
+bool parse_capture_event(std::string_view line, CaptureEvent &ev);
+// Прочитать файл записи целиком; ошибки — исключения
+std::vector<CaptureEvent> load_capture(const std::string &path);
+
+// Файл записи, общий для всех реакторов: открывается на дозапись, и каждая
+// запись в него — целые строки, поэтому строки реакторов не перемешиваются.
+// В файл пишет фоновый поток: реакторы только передают ему готовые пачки и
+// на диске не ждут. Если диск не успевает и в очереди больше kMaxQueuedBytes,
+// пачка отбрасывается и учитывается в dropped() — запись не тормозит запросы.
+class CaptureFile {
+public:
+    // Открывает path на дозапись и пишет заголовок прогона (Start)
+    explicit CaptureFile(const std::string &path, uint64_t start_ns);
+    ~CaptureFile();  // дописывает очередь и останавливает поток
+    uint64_t start_ns() const { return start_ns_; }
+    uint64_t run_base() const { return run_base_; }  // старшие биты номеров соединений
+    // Отдать пачку строк потоку записи; lines получает взамен пустой буфер
+    // из уже записанных, чтобы память не выделялась на каждую пачку
+    void submit(std::string &lines);
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    CaptureFile(const CaptureFile &) = delete;
+    CaptureFile &operator=(const CaptureFile &) = delete;
+private:
+    static const size_t kMaxQueuedBytes = 16 * 1024 * 1024;
+    static const size_t kMaxSpare = 8;
+
+    void write_loop();
+    void write(const std::string &lines);
+
+    int fd_;
+    uint64_t start_ns_;
+    uint64_t run_base_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::string> queue_;   // под mutex_
+    std::vector<std::string> spare_;  // под mutex_
+    size_t queued_bytes_ = 0;         // под mutex_
+    bool stop_ = false;               // под mutex_
+    std::atomic<uint64_t> dropped_{0};
+    std::thread writer_;
+};
+
+// Буфер записи одного реактора: события копятся в памяти и уходят потоку
+// записи пачками, так что запись не добавляет системных вызовов на каждый запрос
+class CaptureBuffer {
+public:
+    explicit CaptureBuffer(CaptureFile &file) : file_(file) {}
+    ~CaptureBuffer() { flush(); }
+
+    void record(CaptureEvent::Kind kind, uint64_t now_ns, uint64_t conn,
+                const char *data = nullptr, size_t len = 0);
+    bool empty() const { return buf_.empty(); }
+    bool full() const { return buf_.size() >= kFlushBytes; }
+    void flush();
+private:
+    static const size_t kFlushBytes = 64 * 1024;
+    CaptureFile &file_;
+    std::string buf_;
+};
@@ -1,4 +1,9 @@
 #include "epoll_wrapper.h"
+#include "calc_core.h"
+#include "binary_proto.h"
+#include "capture.h"
+#include "logger.h"
+#include "metrics.h"
 #include <iostream>
 #include <random>
 #include <string>
@@ -7,73 +12,23 @@
 #include <sstream>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cmath>
 #include <stdexcept>
-
-// Парсер (тот же, что в сервере) для локальной проверки
-class ExprParser {
-    const std::string &s;
-    size_t i;
-public:
-    ExprParser(const std::string &str) : s(str), i(0) {}
-    double parse() {
-        return parseExpression();
-    }
-private:
-    void skipSpaces() {
-        while (i < s.size() && s[i] == ' ') ++i;
-    }
-    double parseNumber() {
-        skipSpaces();
-        size_t start = i;
-        while (i < s.size() && (isdigit(s[i]) || s[i]=='.')) ++i;
-        return std::stod(s.substr(start, i - start));
-    }
-    double parseFactor() {
-        skipSpaces();
-        if (s[i] == '(') {
-            ++i;
-            double v = parseExpression();
-            skipSpaces();
-            ++i; // пропустить ')'
-            return v;
-        }
-        return parseNumber();
-    }
-    double parseTerm() {
-        double lhs = parseFactor();
-        while (true) {
-            skipSpaces();
-            if (i>=s.size()) break;
-            char op = s[i];
-            if (op!='*' && op!='/') break;
-            ++i;
-            double rhs = parseFactor();
-            lhs = (op=='*' ? lhs*rhs : lhs/rhs);
-        }
-        return lhs;
-    }
-    double parseExpression() {
-        double lhs = parseTerm();
-        while (true) {
-            skipSpaces();
-            if (i>=s.size()) break;
-            char op = s[i];
-            if (op!='+' && op!='-') break;
-            ++i;
-            double rhs = parseTerm();
-            lhs = (op=='+' ? lhs+rhs : lhs-rhs);
-        }
-        return lhs;
-    }
-};
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <thread>
 
 // Генерация выражения с пробелами между токенами
 std::string gen_expr(int n) {
     std::ostringstream ss;
-    static std::mt19937_64 rng(std::random_device{}());
+    thread_local std::mt19937_64 rng(std::random_device{}());
     std::uniform_int_distribution<int> dist(1, 100);
     std::uniform_int_distribution<int> op(0, 3);
     const char ops[] = {'+','-','*','/'};
@@ -85,33 +40,970 @@ std::string gen_expr(int n) {
 }
 
 struct Session {
-    std::string expr;
-    double correct;
+    std::string expr;              // всё, что отправляется в сокет
+    std::vector<std::string> exprs; // отправленные выражения (для отчёта о расхождении)
+    std::vector<double> correct;   // ожидаемые ответы по порядку
+    size_t answered = 0;           // сколько ответов уже проверено
     size_t idx = 0;
     int chunk_count = 0;
     std::string recv_buf;
 };
 
+// Сверка ответа сервера с ожидаемым значением. Расхождения выводятся в std::cerr
+// сразу и целиком (вместе с выражением), остальное — через журнал.
+static bool check_answer(int fd, const std::string &expr, const std::string &answer, double correct) {
+    double serv;
+    try {
+        serv = std::stod(answer);
+    } catch (...) {
+        std::cerr<<"[FD="<<fd<<"] ✘ Bad response: '"<<answer
+                 <<"' expr='"<<expr<<"' expected="<<correct<<"\n";
+        return false;
+    }
+    LOG_DEBUG("[FD=%d] Received=%g", fd, serv);
+    if (std::abs(serv - correct) < 1e-6) {
+        LOG_DEBUG("[FD=%d] OK", fd);
+        return true;
+    }
+    std::cerr<<"[FD="<<fd<<"] ✘ Mismatch: expr='"<<expr<<"' server="
+             <<serv<<" expected="<<correct<<"\n";
+    return false;
+}
+
+// Ответ двоичного протокола в том же виде, что и текстовый
+static std::string binary_answer_text(const char *p) {
+    double v;
+    if (!parse_binary_result(p, v)) return "ERROR";
+    char out[kResultBufSize];
+    return std::string(out, format_result(v, out));
+}
+
 static void set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
+// ---------------- Режим нагрузочного тестирования (--bench) ----------------
+
+struct BenchConfig {
+    int n = 0;
+    int connections = 1;     // замкнутый цикл: число одновременных запросов; открытый — пул соединений
+    std::string addr;
+    int port = 0;
+    int threads = 1;
+    double rate = 0;         // запросов в секунду на все потоки; 0 — замкнутый цикл
+    double duration_s = 10;
+    double warmup_s = 1;
+    bool reconnect = false;  // новое соединение на каждый запрос (иначе keep-alive)
+    bool binary = false;     // двоичный протокол вместо текста
+    bool json = false;
+};
+
+// Запрос в полёте: какое выражение и когда его следовало отправить.
+// В открытом цикле задержка считается от запланированного момента, а не от
+// фактической отправки, — так учитывается coordinated omission.
+struct BenchRequest {
+    size_t expr;
+    uint64_t intended_ns;
+};
+
+struct BenchConn {
+    int fd = -1;
+    std::string out;                   // байты к отправке
+    size_t out_off = 0;
+    bool shut_after_send = false;      // одноразовый режим: shutdown(SHUT_WR) после выражения
+    bool magic_sent = false;           // двоичный протокол: байт выбора протокола уже в out
+    std::deque<BenchRequest> inflight; // ожидающие ответа, по порядку отправки
+    std::string in;                    // принятые, ещё не разобранные байты
+    uint32_t events = 0;
+};
+
+// Итоги одного потока
+struct BenchStats {
+    std::vector<uint64_t> hist;   // корзины LatencyHistogram, нс
+    uint64_t completed = 0;       // учтённые (после прогрева) запросы
+    uint64_t errors = 0;          // неверные ответы, ERROR, обрывы соединений
+    uint64_t connect_errors = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+class BenchThread {
+public:
+    BenchThread(const BenchConfig &cfg, int conns, double rate)
+        : cfg_(cfg), conns_limit_(conns), rate_(rate), rng_(std::random_device{}()) {
+        // Набор выражений готовится заранее: генерация и локальная проверка
+        // не должны попадать в измеряемую задержку
+        for (int i = 0; i < 1024; ++i) {
+            exprs_.push_back(gen_expr(cfg.n));
+            expected_.push_back(ExprParser(exprs_.back()).parse());
+            frames_.emplace_back();
+            if (cfg.binary) encode_binary_frame(exprs_.back(), frames_.back());
+        }
+    }
+
+    void run(uint64_t start_ns) {
+        warm_end_ = start_ns + uint64_t(cfg_.warmup_s * 1e9);
+        end_ = warm_end_ + uint64_t(cfg_.duration_s * 1e9);
+        const uint64_t drain_end = end_ + 2000000000ULL; // на дожидание ответов после окончания
+        const uint64_t interval = rate_ > 0 ? uint64_t(1e9 / rate_) : 0;
+        uint64_t next = start_ns;
+
+        if (rate_ <= 0) {
+            for (int i = 0; i < conns_limit_; ++i) issue(start_ns, nullptr);
+        }
+        epoll_event events[64];
+        while (true) {
+            uint64_t now = now_ns();
+            if (now >= drain_end || (now >= end_ && outstanding() == 0)) break;
+            int timeout = 100;
+            if (rate_ > 0 && now < end_) {
+                while (next <= now && next < end_) {
+                    issue(next, nullptr);
+                    next += interval;
+                }
+                timeout = next > now ? int((next - now) / 1000000) : 0;
+            }
+            int ne = ep_.wait(events, 64, timeout);
+            for (int i = 0; i < ne; ++i) handle(static_cast<BenchConn *>(events[i].data.ptr), events[i].events);
+        }
+        // незавершённые к концу запросы — ошибки
+        for (auto &c : conns_) {
+            if (c->fd < 0) continue;
+            stats_.errors += c->inflight.size();
+            close(c->fd);
+        }
+        stats_.errors += backlog_.size();
+    }
+
+    const BenchStats &stats() const { return stats_; }
+    void merge_hist(std::vector<uint64_t> &acc) const { hist_.merge_into(acc); }
+private:
+    size_t outstanding() const {
+        size_t n = backlog_.size();
+        for (auto &c : conns_) if (c->fd >= 0) n += c->inflight.size();
+        return n;
+    }
+
+    // Новое соединение (неблокирующий connect)
+    BenchConn *open_conn() {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) { ++stats_.connect_errors; return nullptr; }
+        set_nonblocking(fd);
+        // фрагменты уходят сразу, иначе Нейгл и отложенный ACK сервера дают +40 мс
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in s{};
+        s.sin_family = AF_INET;
+        s.sin_port = htons(cfg_.port);
+        inet_pton(AF_INET, cfg_.addr.c_str(), &s.sin_addr);
+        if (connect(fd, (sockaddr*)&s, sizeof(s)) < 0 && errno != EINPROGRESS) {
+            close(fd);
+            ++stats_.connect_errors;
+            return nullptr;
+        }
+        BenchConn *c = nullptr;
+        for (auto &slot : conns_) if (slot->fd < 0) { c = slot.get(); break; }
+        if (!c) {
+            conns_.emplace_back(new BenchConn);
+            c = conns_.back().get();
+        }
+        c->fd = fd;
+        c->out.clear();
+        c->out_off = 0;
+        c->shut_after_send = false;
+        c->magic_sent = false;
+        c->inflight.clear();
+        c->in.clear();
+        c->events = EPOLLIN | EPOLLOUT;
+        ep_.add(fd, c->events, c);
+        return c;
+    }
+
+    size_t open_count() const {
+        size_t n = 0;
+        for (auto &c : conns_) if (c->fd >= 0) ++n;
+        return n;
+    }
+
+    // Поставить запрос в соединение: keep-alive — в наименее загруженное
+    // (с конвейером), одноразовый режим — в новое соединение
+    void issue(uint64_t intended, BenchConn *prefer) {
+        BenchRequest req{rng_() % exprs_.size(), intended};
+        BenchConn *c = prefer;
+        if (!c && !cfg_.reconnect) {
+            for (auto &slot : conns_) {
+                if (slot->fd < 0) continue;
+                if (!c || slot->inflight.size() < c->inflight.size()) c = slot.get();
+            }
+            if (!c || (!c->inflight.empty() && open_count() < (size_t)conns_limit_)) {
+                BenchConn *fresh = open_conn();
+                if (fresh) c = fresh;
+            }
+        }
+        if (!c && cfg_.reconnect) {
+            if (open_count() >= (size_t)conns_limit_) { backlog_.push_back(req); return; }
+            c = open_conn();
+        }
+        if (!c) { ++stats_.errors; return; }
+        start_request(c, req);
+    }
+
+    void start_request(BenchConn *c, const BenchRequest &req) {
+        if (cfg_.binary) {
+            if (!c->magic_sent) {
+                c->out.push_back((char)kBinaryMagic);
+                c->magic_sent = true;
+            }
+            c->out.append(frames_[req.expr]);
+        } else {
+            c->out.append(exprs_[req.expr]);
+            if (!cfg_.reconnect) c->out.push_back('\n');
+        }
+        if (cfg_.reconnect) c->shut_after_send = true;
+        c->inflight.push_back(req);
+        flush(c);
+    }
+
+    // Отправка фрагментами случайной длины 1–10 байт, как в обычном режиме клиента
+    bool flush(BenchConn *c) {
+        std::uniform_int_distribution<int> frag(1, 10);
+        while (c->out_off < c->out.size()) {
+            size_t chunk = std::min<size_t>(frag(rng_), c->out.size() - c->out_off);
+            ssize_t w = send(c->fd, c->out.data() + c->out_off, chunk, MSG_NOSIGNAL);
+            if (w > 0) c->out_off += (size_t)w;
+            else if (w < 0 && (errno == EAGAIN || errno == ENOTCONN)) break;
+            else return false;
+        }
+        if (c->out_off >= c->out.size()) {
+            c->out.clear();
+            c->out_off = 0;
+            if (c->shut_after_send) {
+                shutdown(c->fd, SHUT_WR);
+                c->shut_after_send = false;
+            }
+        }
+        uint32_t want = EPOLLIN | (c->out.empty() ? 0u : uint32_t(EPOLLOUT));
+        if (want != c->events) {
+            ep_.modify(c->fd, want, c);
+            c->events = want;
+        }
+        return true;
+    }
+
+    void complete(const BenchRequest &req, const std::string &answer, uint64_t now) {
+        bool ok = false;
+        char *end = nullptr;
+        double v = std::strtod(answer.c_str(), &end);
+        if (end != answer.c_str() && std::abs(v - expected_[req.expr]) < 1e-6) ok = true;
+        if (!ok && stats_.errors < 10)
+            std::cerr << "✘ Mismatch: expr='" << exprs_[req.expr] << "' server='" << answer
+                      << "' expected=" << expected_[req.expr] << "\n";
+        if (req.intended_ns < warm_end_ || req.intended_ns >= end_) return;
+        if (!ok) { ++stats_.errors; return; }
+        uint64_t lat = now > req.intended_ns ? now - req.intended_ns : 0;
+        hist_.record(lat);
+        ++stats_.completed;
+        stats_.sum_ns += lat;
+        if (lat > stats_.max_ns) stats_.max_ns = lat;
+    }
+
+    void drop(BenchConn *c) {
+        stats_.errors += c->inflight.size();
+        c->inflight.clear();
+        ep_.remove(c->fd);
+        close(c->fd);
+        c->fd = -1;
+    }
+
+    void handle(BenchConn *c, uint32_t ev) {
+        if (c->fd < 0) return;
+        bool alive = true;
+        if ((ev & EPOLLOUT) && !flush(c)) alive = false;
+        bool eof = false;
+        if (alive && (ev & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            char buf[4096];
+            while (true) {
+                ssize_t r = recv(c->fd, buf, sizeof(buf), 0);
+                if (r > 0) c->in.append(buf, (size_t)r);
+                else if (r == 0) { eof = true; break; }
+                else if (errno == EAGAIN) break;
+                else { alive = false; break; }
+            }
+        }
+        uint64_t now = now_ns();
+        size_t answered = 0;
+        if (cfg_.binary) {
+            // ответы фиксированной длины, в любом режиме соединений
+            size_t pos = 0;
+            while (!c->inflight.empty() && c->in.size() - pos >= kBinaryResultSize) {
+                complete(c->inflight.front(), binary_answer_text(c->in.data() + pos), now);
+                c->inflight.pop_front();
+                pos += kBinaryResultSize;
+                ++answered;
+            }
+            c->in.erase(0, pos);
+        } else if (!cfg_.reconnect) {
+            size_t pos = 0, nl;
+            while (!c->inflight.empty() && (nl = c->in.find('\n', pos)) != std::string::npos) {
+                complete(c->inflight.front(), c->in.substr(pos, nl - pos), now);
+                c->inflight.pop_front();
+                pos = nl + 1;
+                ++answered;
+            }
+            c->in.erase(0, pos);
+        } else if (eof && !c->inflight.empty()) {
+            complete(c->inflight.front(), c->in, now);
+            c->inflight.pop_front();
+            ++answered;
+        }
+        size_t lost = 0;
+        if (!alive || eof) {
+            lost = c->inflight.size();
+            drop(c);
+        }
+        if (now >= end_) return;
+        if (rate_ <= 0) {
+            // замкнутый цикл: каждый ответ сразу порождает следующий запрос,
+            // а потерянные с оборванным соединением — замену
+            for (size_t i = 0; i < answered + lost; ++i)
+                issue(now, cfg_.reconnect || c->fd < 0 ? nullptr : c);
+        }
+        // двоичный ответ приходит раньше, чем сервер закрывает соединение, так что
+        // и в замкнутом цикле следующий запрос мог встать в очередь
+        if (cfg_.reconnect) {
+            while (!backlog_.empty() && open_count() < (size_t)conns_limit_) {
+                BenchConn *fresh = open_conn();
+                if (!fresh) break;
+                start_request(fresh, backlog_.front());
+                backlog_.pop_front();
+            }
+        }
+    }
+
+    const BenchConfig &cfg_;
+    int conns_limit_;
+    double rate_;
+    std::mt19937_64 rng_;
+    Epoll ep_;
+    std::vector<std::string> exprs_;
+    std::vector<double> expected_;
+    std::vector<std::string> frames_;  // те же выражения в двоичном виде (--binary)
+    std::vector<std::unique_ptr<BenchConn>> conns_;
+    std::deque<BenchRequest> backlog_; // открытый цикл + reconnect: ждут свободного соединения
+    LatencyHistogram hist_;
+    BenchStats stats_;
+    uint64_t warm_end_ = 0, end_ = 0;
+};
+
+static int run_bench(const BenchConfig &cfg) {
+    std::vector<std::unique_ptr<BenchThread>> workers;
+    for (int t = 0; t < cfg.threads; ++t) {
+        int conns = cfg.connections / cfg.threads + (t < cfg.connections % cfg.threads ? 1 : 0);
+        if (conns < 1) conns = 1;
+        workers.emplace_back(new BenchThread(cfg, conns, cfg.rate / cfg.threads));
+    }
+    uint64_t start = now_ns();
+    std::vector<std::thread> threads;
+    for (auto &w : workers) threads.emplace_back(&BenchThread::run, w.get(), start);
+    for (auto &t : threads) t.join();
+
+    std::vector<uint64_t> hist(LatencyHistogram::kBuckets, 0);
+    BenchStats total;
+    for (auto &w : workers) {
+        w->merge_hist(hist);
+        const BenchStats &s = w->stats();
+        total.completed += s.completed;
+        total.errors += s.errors;
+        total.connect_errors += s.connect_errors;
+        total.sum_ns += s.sum_ns;
+        total.max_ns = std::max(total.max_ns, s.max_ns);
+    }
+    double rps = total.completed / cfg.duration_s;
+    double mean_us = total.completed ? total.sum_ns / 1e3 / total.completed : 0;
+    // верхняя граница корзины может превышать наибольшую измеренную задержку
+    auto q = [&](double p) { return std::min<double>(histogram_quantile(hist, p), total.max_ns) / 1e3; };
+    const char *mode = cfg.rate > 0 ? "open" : "closed";
+    if (cfg.json) {
+        printf("{\"mode\":\"%s\",\"threads\":%d,\"connections\":%d,\"rate\":%.0f,\"n\":%d,"
+               "\"keep_alive\":%s,\"binary\":%s,\"duration_s\":%.3f,\"warmup_s\":%.3f,"
+               "\"requests\":%llu,\"errors\":%llu,\"connect_errors\":%llu,\"rps\":%.1f,"
+               "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               mode, cfg.threads, cfg.connections, cfg.rate, cfg.n, cfg.reconnect ? "false" : "true",
+               cfg.binary ? "true" : "false",
+               cfg.duration_s, cfg.warmup_s, (unsigned long long)total.completed,
+               (unsigned long long)total.errors, (unsigned long long)total.connect_errors, rps,
+               mean_us, q(0.5), q(0.9), q(0.99), q(0.999), total.max_ns / 1e3);
+    } else {
+        printf("mode=%s threads=%d connections=%d rate=%.0f n=%d %s duration=%.1fs warmup=%.1fs\n"
+               "requests=%llu errors=%llu connect_errors=%llu rps=%.1f\n"
+               "latency_us mean=%.1f p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+               mode, cfg.threads, cfg.connections, cfg.rate, cfg.n,
+               cfg.reconnect ? "reconnect" : "keep-alive", cfg.duration_s, cfg.warmup_s,
+               (unsigned long long)total.completed, (unsigned long long)total.errors,
+               (unsigned long long)total.connect_errors, rps,
+               mean_us, q(0.5), q(0.9), q(0.99), q(0.999), total.max_ns / 1e3);
+    }
+    return total.errors || total.connect_errors ? 2 : 0;
+}
+
+// ---------------- Воспроизведение записи сервера (--replay) ----------------
+
+struct ReplayConfig {
+    std::string path;
+    int connections = 1;     // сколько записанных соединений открыто одновременно
+    std::string addr;
+    int port = 0;
+    int threads = 1;
+    double speed = 1;        // 1 — исходный темп, 2 — вдвое быстрее, 0 — без пауз
+    bool json = false;
+};
+
+// Фрагмент, который клиент отправил одним вызовом (или закрытие передачи)
+struct ReplayStep {
+    uint64_t t;
+    std::string data;
+    bool eof = false;
+    size_t gate = 0;         // сколько байт ответов клиент получил к этому моменту
+};
+
+// Записанный ответ: где он кончается в потоке ответов и после какого шага пришёл
+struct ReplayReply {
+    size_t end;
+    size_t step;
+};
+
+// Одно записанное соединение
+struct ReplayConn {
+    uint64_t open_t = 0;
+    std::vector<ReplayStep> steps;
+    std::string expected;    // все ответы сервера подряд
+    std::vector<ReplayReply> replies;
+};
+
+// Прогон записи: время его событий отсчитывается от epoch
+struct ReplayRun {
+    uint64_t epoch = 0;
+    uint64_t first = UINT64_MAX, last = 0;  // время первого и последнего события
+    uint64_t base = 0;                      // абсолютное время, ставшее нулём воспроизведения
+};
+
+// Прогоны, дописанные в файл разными процессами, — на одну шкалу. Перекрывшиеся
+// по времени (старый и новый процесс при --handoff) сохраняют взаимный сдвиг,
+// а пауза между последовательными запусками выбрасывается.
+static void align_runs(std::vector<CaptureEvent> &events) {
+    std::unordered_map<uint64_t, ReplayRun> runs;
+    for (const auto &ev : events) {
+        ReplayRun &run = runs[capture_run(ev.conn)];
+        if (ev.kind == CaptureEvent::Start) {
+            run.epoch = ev.epoch;
+            continue;
+        }
+        run.first = std::min(run.first, ev.t);
+        run.last = std::max(run.last, ev.t);
+    }
+    std::vector<ReplayRun *> order;
+    for (auto &r : runs)
+        if (r.second.first != UINT64_MAX) order.push_back(&r.second);
+    std::sort(order.begin(), order.end(), [](const ReplayRun *a, const ReplayRun *b) {
+        return a->epoch + a->first < b->epoch + b->first;
+    });
+    uint64_t end = 0;         // конец уже размещённых прогонов на шкале воспроизведения
+    uint64_t abs_end = 0;     // он же в абсолютном времени
+    uint64_t base = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        ReplayRun &run = *order[i];
+        uint64_t abs_first = run.epoch + run.first;
+        if (i == 0 || abs_first > abs_end) base = abs_first - end; // новый запуск — сразу за предыдущими
+        run.base = base;
+        abs_end = std::max(abs_end, run.epoch + run.last);
+        end = abs_end - base;
+    }
+    for (auto &ev : events) {
+        const ReplayRun &run = runs[capture_run(ev.conn)];
+        ev.t = run.epoch + ev.t - run.base;
+    }
+}
+
+// Соединения записи по порядку открытия. Номер, встреченный снова после
+// "open", — уже другое соединение (файл без заголовков прогонов мог
+// дописываться несколькими запусками).
+static std::vector<ReplayConn> load_replay(const std::string &path) {
+    std::vector<CaptureEvent> events = load_capture(path);
+    align_runs(events);
+    std::vector<ReplayConn> conns;
+    std::unordered_map<uint64_t, size_t> current;
+    for (auto &ev : events) {
+        if (ev.kind == CaptureEvent::Start) continue;
+        auto it = current.find(ev.conn);
+        if (it == current.end() || ev.kind == CaptureEvent::Open) {
+            current[ev.conn] = conns.size();
+            conns.emplace_back();
+            conns.back().open_t = ev.t;
+            if (ev.kind == CaptureEvent::Open) continue;
+            it = current.find(ev.conn);
+        }
+        ReplayConn &c = conns[it->second];
+        switch (ev.kind) {
+        case CaptureEvent::In:
+        case CaptureEvent::Eof:
+            c.steps.push_back({ev.t, std::move(ev.data), ev.kind == CaptureEvent::Eof, c.expected.size()});
+            break;
+        case CaptureEvent::Out:
+            c.expected += ev.data;
+            c.replies.push_back({c.expected.size(), c.steps.empty() ? SIZE_MAX : c.steps.size() - 1});
+            break;
+        case CaptureEvent::Start:
+        case CaptureEvent::Open:
+            break;
+        }
+    }
+    std::stable_sort(conns.begin(), conns.end(),
+                     [](const ReplayConn &a, const ReplayConn &b) { return a.open_t < b.open_t; });
+    return conns;
+}
+
+// Байты ответа для сообщения о расхождении
+static std::string printable(const std::string &s, size_t from, size_t len) {
+    std::string out;
+    for (size_t i = from; i < s.size() && i < from + len; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (c >= 0x20 && c < 0x7f) {
+            out += (char)c;
+        } else {
+            char esc[8];
+            snprintf(esc, sizeof(esc), "\\x%02x", c);
+            out += esc;
+        }
+    }
+    return out;
+}
+
+// Поток воспроизведения: свои соединения записи, свой epoll. Шаг соединения
+// отправляется в свой момент записи (с учётом speed), но не раньше, чем пришли
+// ответы, которые клиент получил до него в записи, — так сохраняется
+// зависимость запросов от ответов. Принятое сверяется с записанными ответами.
+class ReplayThread {
+public:
+    ReplayThread(const ReplayConfig &cfg, std::vector<const ReplayConn *> conns, int limit)
+        : cfg_(cfg), limit_(limit), pending_(std::move(conns)) {}
+
+    void run(uint64_t start_ns) {
+        start_ = start_ns;
+        epoll_event events[64];
+        while (next_open_ < pending_.size() || active_ > 0) {
+            uint64_t now = now_ns();
+            open_due(now);
+            while (!due_.empty() && due_.top().at <= now) {
+                Due d = due_.top();
+                due_.pop();
+                if (d.state->gen == d.gen) send_step(d.state, now); // иначе соединение закрыто, состояние отдано другому
+            }
+            check_stalled(now);
+            int timeout = 100;
+            if (!due_.empty()) timeout = std::min<uint64_t>(timeout, (due_.top().at - now + 999999) / 1000000);
+            if (next_open_ < pending_.size() && active_ < limit_) {
+                uint64_t at = scheduled(pending_[next_open_]->open_t);
+                timeout = at > now ? std::min<uint64_t>(timeout, (at - now + 999999) / 1000000) : 0;
+            }
+            int ne = ep_.wait(events, 64, timeout);
+            for (int i = 0; i < ne; ++i) handle(static_cast<State *>(events[i].data.ptr), events[i].events);
+        }
+    }
+
+    const BenchStats &stats() const { return stats_; }
+    void merge_hist(std::vector<uint64_t> &acc) const { hist_.merge_into(acc); }
+private:
+    static constexpr uint64_t kStallNs = 5000000000ULL; // столько ждём ответа, прежде чем сдаться
+
+    // Состояния закрытых соединений переиспользуются: их не больше limit_ одновременно
+    struct State {
+        const ReplayConn *rec = nullptr;
+        uint64_t gen = 0;              // меняется при каждом переиспользовании
+        int fd = -1;
+        size_t next_step = 0;          // первый не отправленный шаг
+        bool queued = false;           // следующий шаг уже в due_
+        uint64_t due_ns = 0;           // и когда он должен уйти
+        std::vector<uint64_t> sent_ns; // когда шаг должен был уйти (от этого считается задержка)
+        std::string out;
+        size_t out_off = 0;
+        bool shut_after_send = false;
+        size_t received = 0;           // сколько байт ответов сверено
+        size_t next_reply = 0;
+        uint64_t progress_ns = 0;
+        uint32_t events = 0;
+    };
+    struct Due {
+        uint64_t at;
+        uint64_t gen;                  // поколение состояния, когда шаг ставился в очередь
+        State *state;
+        bool operator>(const Due &o) const { return at > o.at; }
+    };
+
+    // Момент записи t в часах воспроизведения; при speed 0 — «уже пора»
+    uint64_t scheduled(uint64_t t) const {
+        return cfg_.speed > 0 ? start_ + uint64_t(t / cfg_.speed) : 0;
+    }
+
+    void open_due(uint64_t now) {
+        while (next_open_ < pending_.size() && active_ < limit_ &&
+               scheduled(pending_[next_open_]->open_t) <= now) {
+            const ReplayConn *rec = pending_[next_open_++];
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0) { lose(rec); continue; }
+            set_nonblocking(fd);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            sockaddr_in s{};
+            s.sin_family = AF_INET;
+            s.sin_port = htons(cfg_.port);
+            inet_pton(AF_INET, cfg_.addr.c_str(), &s.sin_addr);
+            if (connect(fd, (sockaddr*)&s, sizeof(s)) < 0 && errno != EINPROGRESS) {
+                close(fd);
+                lose(rec);
+                continue;
+            }
+            State *st = acquire();
+            st->rec = rec;
+            st->fd = fd;
+            st->sent_ns.assign(rec->steps.size(), 0);
+            st->progress_ns = now;
+            st->events = EPOLLIN;
+            ep_.add(fd, st->events, st);
+            ++active_;
+            schedule_next(st, now);
+        }
+    }
+
+    State *acquire() {
+        State *st;
+        if (free_.empty()) {
+            states_.emplace_back(new State);
+            st = states_.back().get();
+        } else {
+            st = free_.back();
+            free_.pop_back();
+        }
+        ++st->gen;
+        st->next_step = 0;
+        st->queued = false;
+        st->out.clear();
+        st->out_off = 0;
+        st->shut_after_send = false;
+        st->received = 0;
+        st->next_reply = 0;
+        return st;
+    }
+
+    // Соединение не открылось: все его ответы потеряны
+    void lose(const ReplayConn *rec) {
+        ++stats_.connect_errors;
+        stats_.errors += rec->replies.size();
+    }
+
+    // Поставить следующий шаг в очередь, если его ответы-предшественники уже пришли
+    void schedule_next(State *s, uint64_t now) {
+        if (s->queued) return;
+        if (s->next_step >= s->rec->steps.size()) {
+            if (s->received == s->rec->expected.size() && s->out.empty()) finish(s);
+            return;
+        }
+        const ReplayStep &step = s->rec->steps[s->next_step];
+        if (s->received < step.gate) return;
+        s->queued = true;
+        s->due_ns = std::max(scheduled(step.t), now);
+        due_.push({s->due_ns, s->gen, s});
+    }
+
+    void send_step(State *s, uint64_t now) {
+        s->queued = false;
+        if (s->fd < 0) return;
+        const ReplayStep &step = s->rec->steps[s->next_step];
+        s->sent_ns[s->next_step++] = s->due_ns;
+        s->out.append(step.data);
+        if (step.eof) s->shut_after_send = true;
+        s->progress_ns = now;
+        if (!flush(s)) {
+            drop(s, "send failed");
+            return;
+        }
+        schedule_next(s, now);
+    }
+
+    // Шаг уходит одним send, чтобы граница фрагмента совпала с записанной
+    bool flush(State *s) {
+        while (s->out_off < s->out.size()) {
+            ssize_t w = send(s->fd, s->out.data() + s->out_off, s->out.size() - s->out_off, MSG_NOSIGNAL);
+            if (w > 0) s->out_off += (size_t)w;
+            else if (w < 0 && (errno == EAGAIN || errno == ENOTCONN)) break;
+            else return false;
+        }
+        if (s->out_off >= s->out.size()) {
+            s->out.clear();
+            s->out_off = 0;
+            if (s->shut_after_send) {
+                shutdown(s->fd, SHUT_WR);
+                s->shut_after_send = false;
+            }
+        }
+        uint32_t want = EPOLLIN | (s->out.empty() ? 0u : uint32_t(EPOLLOUT));
+        if (want != s->events) {
+            ep_.modify(s->fd, want, s);
+            s->events = want;
+        }
+        return true;
+    }
+
+    void handle(State *s, uint32_t ev) {
+        if (s->fd < 0) return;
+        uint64_t now = now_ns();
+        if ((ev & EPOLLOUT) && !flush(s)) {
+            drop(s, "send failed");
+            return;
+        }
+        if (!(ev & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            schedule_next(s, now);
+            return;
+        }
+        char buf[4096];
+        while (true) {
+            ssize_t r = recv(s->fd, buf, sizeof(buf), 0);
+            if (r > 0) {
+                if (!accept_bytes(s, buf, (size_t)r, now)) return;
+            }
+            else if (r == 0) {
+                if (s->received < s->rec->expected.size()) drop(s, "connection closed by server");
+                else finish(s);
+                return;
+            }
+            else if (errno == EAGAIN) break;
+            else {
+                drop(s, strerror(errno));
+                return;
+            }
+        }
+        schedule_next(s, now);
+    }
+
+    // Сверка принятых байт с записанными ответами; false — расхождение, соединение закрыто
+    bool accept_bytes(State *s, const char *data, size_t len, uint64_t now) {
+        const std::string &exp = s->rec->expected;
+        size_t same = 0;
+        while (same < len && s->received + same < exp.size() && data[same] == exp[s->received + same]) ++same;
+        s->received += same;
+        s->progress_ns = now;
+        while (s->next_reply < s->rec->replies.size() && s->rec->replies[s->next_reply].end <= s->received) {
+            const ReplayReply &reply = s->rec->replies[s->next_reply++];
+            ++stats_.completed;
+            if (reply.step == SIZE_MAX || !s->sent_ns[reply.step]) continue;
+            uint64_t lat = now > s->sent_ns[reply.step] ? now - s->sent_ns[reply.step] : 0;
+            hist_.record(lat);
+            stats_.sum_ns += lat;
+            if (lat > stats_.max_ns) stats_.max_ns = lat;
+        }
+        if (same == len) return true;
+        if (stats_.errors < 10) {
+            size_t from = s->next_reply ? s->rec->replies[s->next_reply - 1].end : 0;
+            size_t to = s->next_reply < s->rec->replies.size() ? s->rec->replies[s->next_reply].end : exp.size();
+            std::cerr << "✘ Mismatch: reply " << s->next_reply << " server='"
+                      << printable(std::string(data, len), 0, 64) << "' expected='"
+                      << printable(exp, from, std::min<size_t>(to - from, 64)) << "'\n";
+        }
+        drop(s, nullptr);
+        return false;
+    }
+
+    // Оставшиеся ответы соединения — ошибки
+    void drop(State *s, const char *why) {
+        size_t missing = s->rec->replies.size() - s->next_reply;
+        if (why && missing && stats_.errors < 10)
+            std::cerr << "✘ " << why << ", " << missing << " repl" << (missing == 1 ? "y" : "ies")
+                      << " missing\n";
+        stats_.errors += missing;
+        s->next_reply = s->rec->replies.size();
+        finish(s);
+    }
+
+    void finish(State *s) {
+        if (s->fd < 0) return;
+        ep_.remove(s->fd);
+        close(s->fd);
+        s->fd = -1;
+        --active_;
+        free_.push_back(s);
+    }
+
+    // Сервер молчит слишком долго, хотя следующий шаг ждёт его ответа
+    void check_stalled(uint64_t now) {
+        if (now - last_check_ < 100000000ULL) return;
+        last_check_ = now;
+        for (auto &s : states_)
+            if (s->fd >= 0 && !s->queued && now - s->progress_ns > kStallNs) drop(s.get(), "no reply in 5 s");
+    }
+
+    const ReplayConfig &cfg_;
+    size_t limit_;
+    std::vector<const ReplayConn *> pending_; // по времени открытия
+    size_t next_open_ = 0;
+    size_t active_ = 0;
+    uint64_t start_ = 0;
+    uint64_t last_check_ = 0;
+    Epoll ep_;
+    std::vector<std::unique_ptr<State>> states_;
+    std::vector<State *> free_;               // закрытые, готовые к переиспользованию
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> due_; // шаги к отправке по времени
+    LatencyHistogram hist_;
+    BenchStats stats_;
+};
+
+static int run_replay(const ReplayConfig &cfg) {
+    std::vector<ReplayConn> conns;
+    try {
+        conns = load_replay(cfg.path);
+    } catch (const std::exception &e) {
+        std::cerr << "Failed to load " << cfg.path << ": " << e.what() << "\n";
+        return 1;
+    }
+    size_t replies = 0;
+    for (auto &c : conns) replies += c.replies.size();
+    // соединения делятся между потоками по кругу, лимит одновременных — поровну
+    std::vector<std::unique_ptr<ReplayThread>> workers;
+    for (int t = 0; t < cfg.threads; ++t) {
+        std::vector<const ReplayConn *> mine;
+        for (size_t i = (size_t)t; i < conns.size(); i += (size_t)cfg.threads) mine.push_back(&conns[i]);
+        int limit = cfg.connections / cfg.threads + (t < cfg.connections % cfg.threads ? 1 : 0);
+        workers.emplace_back(new ReplayThread(cfg, std::move(mine), std::max(limit, 1)));
+    }
+    uint64_t start = now_ns();
+    std::vector<std::thread> threads;
+    for (auto &w : workers) threads.emplace_back(&ReplayThread::run, w.get(), start);
+    for (auto &t : threads) t.join();
+    double elapsed_s = (now_ns() - start) / 1e9;
+
+    std::vector<uint64_t> hist(LatencyHistogram::kBuckets, 0);
+    BenchStats total;
+    for (auto &w : workers) {
+        w->merge_hist(hist);
+        const BenchStats &s = w->stats();
+        total.completed += s.completed;
+        total.errors += s.errors;
+        total.connect_errors += s.connect_errors;
+        total.sum_ns += s.sum_ns;
+        total.max_ns = std::max(total.max_ns, s.max_ns);
+    }
+    uint64_t timed = 0;
+    for (uint64_t b : hist) timed += b;
+    double rps = elapsed_s > 0 ? total.completed / elapsed_s : 0;
+    double mean_us = timed ? total.sum_ns / 1e3 / timed : 0;
+    // верхняя граница корзины может превышать наибольшую измеренную задержку
+    auto q = [&](double p) { return std::min<double>(histogram_quantile(hist, p), total.max_ns) / 1e3; };
+    if (cfg.json) {
+        printf("{\"mode\":\"replay\",\"threads\":%d,\"connections\":%d,\"speed\":%g,\"recorded_connections\":%zu,"
+               "\"recorded_replies\":%zu,\"elapsed_s\":%.3f,\"requests\":%llu,\"errors\":%llu,"
+               "\"connect_errors\":%llu,\"rps\":%.1f,"
+               "\"latency_us\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+               cfg.threads, cfg.connections, cfg.speed, conns.size(), replies, elapsed_s,
+               (unsigned long long)total.completed, (unsigned long long)total.errors,
+               (unsigned long long)total.connect_errors, rps,
+               mean_us, q(0.5), q(0.9), q(0.99), q(0.999), total.max_ns / 1e3);
+    } else {
+        printf("mode=replay threads=%d connections=%d speed=%g recorded: connections=%zu replies=%zu\n"
+               "elapsed=%.3fs requests=%llu errors=%llu connect_errors=%llu rps=%.1f\n"
+               "latency_us mean=%.1f p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+               cfg.threads, cfg.connections, cfg.speed, conns.size(), replies, elapsed_s,
+               (unsigned long long)total.completed, (unsigned long long)total.errors,
+               (unsigned long long)total.connect_errors, rps,
+               mean_us, q(0.5), q(0.9), q(0.99), q(0.999), total.max_ns / 1e3);
+    }
+    return total.errors || total.connect_errors ? 2 : 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
+    if (argc < 5) {
         std::cerr << "Usage: " << argv[0]
-                  << " <n> <connections> <server_addr> <server_port>\n";
+                  << " <n> <connections> <server_addr> <server_port> [--keep-alive K] [--binary]"
+                  << " [--log-level trace|debug|info|warn|error|off]\n"
+                  << "       " << argv[0]
+                  << " <n> <connections> <server_addr> <server_port> --bench [--threads T]"
+                  << " [--rate RPS] [--duration S] [--warmup S] [--reconnect] [--binary] [--json]\n"
+                  << "       " << argv[0]
+                  << " <n> <connections> <server_addr> <server_port> --replay FILE [--speed X]"
+                  << " [--threads T] [--json]\n";
         return 1;
     }
     int n = std::stoi(argv[1]);
     int connections = std::stoi(argv[2]);
     std::string addr = argv[3];
     int port = std::stoi(argv[4]);
+    // keep-alive: K выражений на соединение, отправляются подряд без ожидания ответов
+    int per_conn = 0;
+    LogLevel log_level = LogLevel::Info; // выражения и ответы — debug, фрагменты — trace
+    bool bench = false;
+    bool binary = false; // кадры двоичного протокола вместо текста
+    BenchConfig bcfg;
+    ReplayConfig rcfg;
+    for (int a = 5; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--keep-alive" && a + 1 < argc) per_conn = std::stoi(argv[++a]);
+        else if (arg == "--bench") bench = true;
+        else if (arg == "--replay" && a + 1 < argc) rcfg.path = argv[++a];
+        else if (arg == "--speed" && a + 1 < argc) rcfg.speed = std::stod(argv[++a]);
+        else if (arg == "--threads" && a + 1 < argc) bcfg.threads = std::stoi(argv[++a]);
+        else if (arg == "--rate" && a + 1 < argc) bcfg.rate = std::stod(argv[++a]);
+        else if (arg == "--duration" && a + 1 < argc) bcfg.duration_s = std::stod(argv[++a]);
+        else if (arg == "--warmup" && a + 1 < argc) bcfg.warmup_s = std::stod(argv[++a]);
+        else if (arg == "--reconnect") bcfg.reconnect = true;
+        else if (arg == "--json") bcfg.json = true;
+        else if (arg == "--binary") bcfg.binary = binary = true;
+        else if (arg == "--log-level" && a + 1 < argc) {
+            if (!parse_log_level(argv[++a], log_level)) {
+                std::cerr << "Unknown log level: " << argv[a] << "\n";
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (!rcfg.path.empty()) {
+        // воспроизведение записи: n не используется, connections — лимит одновременных
+        rcfg.connections = std::max(connections, 1);
+        rcfg.addr = addr;
+        rcfg.port = port;
+        rcfg.threads = std::max(bcfg.threads, 1);
+        rcfg.json = bcfg.json;
+        if (rcfg.connections < rcfg.threads) rcfg.connections = rcfg.threads;
+        Logger::instance().set_level(log_level);
+        Logger::instance().start();
+        int rc = run_replay(rcfg);
+        Logger::instance().stop();
+        return rc;
+    }
+    if (bench) {
+        // нагрузочный режим тихий: итог печатается одной сводкой
+        bcfg.n = n;
+        bcfg.connections = connections;
+        bcfg.addr = addr;
+        bcfg.port = port;
+        if (bcfg.threads < 1) bcfg.threads = 1;
+        if (bcfg.connections < bcfg.threads) bcfg.connections = bcfg.threads;
+        if (bcfg.duration_s <= 0) bcfg.duration_s = 1;
+        Logger::instance().set_level(log_level);
+        Logger::instance().start();
+        int rc = run_bench(bcfg);
+        Logger::instance().stop();
+        return rc;
+    }
+    bool keep_alive = per_conn > 0;
+    if (!keep_alive) per_conn = 1;
 
-    std::cout << "Client: n="<<n
-              <<", sessions="<<connections
-              <<", server="<<addr<<":"<<port<<"\n"
-              <<"----------------------------------------\n";
+    Logger::instance().set_level(log_level);
+    Logger::instance().start();
+    LOG_INFO("Client: n=%d, sessions=%d, server=%s:%d%s%s", n, connections, addr.c_str(), port,
+             keep_alive ? (", keep-alive requests/session=" + std::to_string(per_conn)).c_str() : "",
+             binary ? ", binary" : "");
+    size_t ok_count = 0, failed_count = 0;
 
     Epoll ep;
     std::unordered_map<int, Session> sessions;
@@ -127,13 +1019,20 @@ int main(int argc, char *argv[]) {
         connect(sock, (sockaddr*)&s, sizeof(s)); // неблокирующий connect
 
         Session sess;
-        sess.expr = gen_expr(n);
-        sess.correct = ExprParser(sess.expr).parse();
+        if (binary) sess.expr += (char)kBinaryMagic;
+        for (int k = 0; k < per_conn; ++k) {
+            std::string e = gen_expr(n);
+            double correct = ExprParser(e).parse();
+            LOG_DEBUG("[FD=%d] Expr='%s' expected=%g", sock, e.c_str(), correct);
+            if (binary) encode_binary_frame(e, sess.expr);
+            else sess.expr += e;
+            if (keep_alive && !binary) sess.expr += '\n';
+            sess.exprs.push_back(std::move(e));
+            sess.correct.push_back(correct);
+        }
         sessions[sock] = sess;
 
         ep.add(sock, EPOLLOUT | EPOLLIN);
-        std::cout << "[FD="<<sock<<"] Expr='"<<sess.expr
-                  <<"' expected="<<sess.correct<<"\n";
     }
 
     epoll_event events[64];
@@ -153,27 +1052,48 @@ int main(int argc, char *argv[]) {
                 int sent = send(fd, sess.expr.data() + sess.idx, chunk, 0);
                 if (sent > 0) {
                     sess.idx += sent; sess.chunk_count++;
-                    std::cout << "[FD="<<fd<<"] Sent chunk "<<sess.chunk_count
-                              <<" ('"<<sess.expr.substr(sess.idx-sent, sent)<<"')\n";
-                    if (sess.idx >= sess.expr.size()) shutdown(fd, SHUT_WR);
+                    if (binary) LOG_TRACE("[FD=%d] Sent chunk %d (%d bytes)", fd, sess.chunk_count, sent);
+                    else LOG_TRACE("[FD=%d] Sent chunk %d ('%.*s')", fd, sess.chunk_count,
+                                   sent, sess.expr.data() + sess.idx - sent);
+                    // в keep-alive соединение закрывается после всех ответов
+                    // двоичные ответы самоограничены: соединение закрывается после всех ответов
+                    if (sess.idx >= sess.expr.size() && !keep_alive && !binary) shutdown(fd, SHUT_WR);
                 }
             }
 
             // приём ответа
             if (events[j].events & EPOLLIN) {
                 char buf[128];
-                int r = recv(fd, buf, sizeof(buf)-1, 0);
+                int r = recv(fd, buf, sizeof(buf), 0);
+                bool done = false;
                 if (r > 0) {
-                    buf[r] = '\0';
-                    sess.recv_buf += buf;
+                    sess.recv_buf.append(buf, r);
+                    // двоичные ответы — по kBinaryResultSize байт на кадр
+                    while (binary && sess.answered < sess.correct.size() &&
+                           sess.recv_buf.size() >= kBinaryResultSize) {
+                        size_t k = sess.answered++;
+                        ++(check_answer(fd, sess.exprs[k], binary_answer_text(sess.recv_buf.data()),
+                                        sess.correct[k]) ? ok_count : failed_count);
+                        sess.recv_buf.erase(0, kBinaryResultSize);
+                    }
+                    // в keep-alive ответы приходят строками, по одной на выражение
+                    size_t nl;
+                    while (keep_alive && sess.answered < sess.correct.size() &&
+                           (nl = sess.recv_buf.find('\n')) != std::string::npos) {
+                        size_t k = sess.answered++;
+                        ++(check_answer(fd, sess.exprs[k], sess.recv_buf.substr(0, nl), sess.correct[k])
+                               ? ok_count : failed_count);
+                        sess.recv_buf.erase(0, nl + 1);
+                    }
+                    done = (keep_alive || binary) && sess.answered == sess.correct.size();
                 } else {
-                    double serv = std::stod(sess.recv_buf);
-                    std::cout << "[FD="<<fd<<"] Received="<<serv<<"\n";
-                    if (std::abs(serv - sess.correct) < 1e-6)
-                        std::cout<<"[FD="<<fd<<"] ✔ OK\n";
-                    else
-                        std::cerr<<"[FD="<<fd<<"] ✘ Mismatch: server="
-                                 <<serv<<" expected="<<sess.correct<<"\n";
+                    // недополученные ответы считаются ошибками
+                    for (size_t k = sess.answered; k < sess.correct.size(); ++k)
+                        ++(check_answer(fd, sess.exprs[k], k == sess.answered && !binary ? sess.recv_buf : "",
+                                        sess.correct[k]) ? ok_count : failed_count);
+                    done = true;
+                }
+                if (done) {
                     ep.remove(fd);
                     close(fd);
                     sessions.erase(fd);
@@ -182,6 +1102,7 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    std::cout<<"All sessions completed\n";
-    return 0;
+    LOG_INFO("All sessions completed: ok=%zu failed=%zu", ok_count, failed_count);
+    Logger::instance().stop();
+    return failed_count ? 2 : 0;
 }
\ No newline at end of file
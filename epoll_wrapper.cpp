@@ -2,8 +2,16 @@
 #ifdef _WIN32
 #include <stdexcept>
 
-// Инициализация Winsock
-Epoll::Epoll() {
+// Перевод маски epoll в события WSAPoll
+static SHORT to_poll_events(uint32_t events) {
+    SHORT pe = 0;
+    if (events & EPOLLIN) pe |= POLLRDNORM;
+    if (events & EPOLLOUT) pe |= POLLWRNORM;
+    return pe;
+}
+
+// Инициализация Winsock (io_uring на Windows нет, всегда WSAPoll)
+Epoll::Epoll(Backend) {
     WSADATA wsa;
     WSAStartup(MAKEWORD(2,2), &wsa);
 }
@@ -11,21 +19,56 @@ Epoll::Epoll() {
 Epoll::~Epoll() {
     WSACleanup();
 }
-// Добавление сокета в faux-epoll через WSAPoll
 bool Epoll::add(int fd, uint32_t events) {
+    epoll_data_t data;
+    data.u64 = 0;
+    data.fd = fd;
+    return add(fd, events, data);
+}
+bool Epoll::add(int fd, uint32_t events, void *ptr) {
+    epoll_data_t data;
+    data.ptr = ptr;
+    return add(fd, events, data);
+}
+// Добавление сокета в faux-epoll через WSAPoll.
+// WSAPoll работает только по уровню, поэтому EPOLLET игнорируется.
+bool Epoll::add(int fd, uint32_t events, epoll_data_t data) {
     WSAPOLLFD pfd;
     pfd.fd = (SOCKET)fd;
-    pfd.events = 0;
-    if (events & EPOLLIN) pfd.events |= POLLRDNORM;
-    if (events & EPOLLOUT) pfd.events |= POLLWRNORM;
+    pfd.events = to_poll_events(events);
+    pfd.revents = 0;
     fds.push_back(pfd);
+    entries.push_back(Entry{events, data, true});
     return true;
 }
+bool Epoll::modify(int fd, uint32_t events) {
+    epoll_data_t data;
+    data.u64 = 0;
+    data.fd = fd;
+    return modify(fd, events, data);
+}
+bool Epoll::modify(int fd, uint32_t events, void *ptr) {
+    epoll_data_t data;
+    data.ptr = ptr;
+    return modify(fd, events, data);
+}
+// Смена маски и данных уже добавленного сокета
+bool Epoll::modify(int fd, uint32_t events, epoll_data_t data) {
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].fd == (SOCKET)fd) {
+            fds[i].events = to_poll_events(events);
+            entries[i] = Entry{events, data, true};
+            return true;
+        }
+    }
+    return false;
+}
 // Удаление сокета из списка
 bool Epoll::remove(int fd) {
-    for (auto it = fds.begin(); it != fds.end(); ++it) {
-        if (it->fd == (SOCKET)fd) {
-            fds.erase(it);
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].fd == (SOCKET)fd) {
+            fds.erase(fds.begin() + i);
+            entries.erase(entries.begin() + i);
             return true;
         }
     }
@@ -40,41 +83,96 @@ int Epoll::wait(epoll_event *events, int maxevents, int timeout) {
         uint32_t re = 0;
         if (fds[i].revents & POLLRDNORM) re |= EPOLLIN;
         if (fds[i].revents & POLLWRNORM) re |= EPOLLOUT;
-        if (re) {
-            events[count].data.fd = fds[i].fd;
+        if (fds[i].revents & POLLHUP) re |= EPOLLHUP;
+        if (fds[i].revents & POLLERR) re |= EPOLLERR;
+        if (re && entries[i].armed) {
+            events[count].data = entries[i].data;
             events[count].events = re;
             ++count;
+            // EPOLLONESHOT: больше не опрашиваем до следующего modify
+            if (entries[i].events & EPOLLONESHOT) {
+                entries[i].armed = false;
+                fds[i].events = 0;
+            }
         }
     }
     return count;
 }
+Epoll::Backend Epoll::backend() const {
+    return Backend::Epoll;
+}
 #else
+#include "uring_poller.h"
 #include <unistd.h>
 #include <stdexcept>
 #include <errno.h>
 
-// Создание epoll-дескриптора
-Epoll::Epoll() {
+// Размер очереди io_uring: с запасом на одну итерацию цикла событий
+static const unsigned kUringEntries = 1024;
+
+// Создание io_uring (если запрошен и доступен) или epoll-дескриптора
+Epoll::Epoll(Backend requested) : epfd(-1), uring(nullptr) {
+    if (requested == Backend::IoUring) {
+        uring = UringPoller::create(kUringEntries);
+        if (uring) return;
+    }
     epfd = epoll_create1(0);
     if (epfd < 0) throw std::runtime_error("epoll_create1 failed");
 }
 // Закрытие epoll-дескриптора
 Epoll::~Epoll() {
-    close(epfd);
+    delete uring;
+    if (epfd >= 0) close(epfd);
+}
+Epoll::Backend Epoll::backend() const {
+    return uring ? Backend::IoUring : Backend::Epoll;
 }
 // Добавление файла/сокета в epoll
 bool Epoll::add(int fd, uint32_t events) {
+    epoll_data_t data;
+    data.u64 = 0;
+    data.fd = fd;
+    return add(fd, events, data);
+}
+bool Epoll::add(int fd, uint32_t events, void *ptr) {
+    epoll_data_t data;
+    data.ptr = ptr;
+    return add(fd, events, data);
+}
+bool Epoll::add(int fd, uint32_t events, epoll_data_t data) {
+    if (uring) return uring->add(fd, events, data);
     struct epoll_event ev;
     ev.events = events;
-    ev.data.fd = fd;
+    ev.data = data;
     return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
 }
+// Смена маски событий без удаления/добавления (один системный вызов)
+bool Epoll::modify(int fd, uint32_t events) {
+    epoll_data_t data;
+    data.u64 = 0;
+    data.fd = fd;
+    return modify(fd, events, data);
+}
+bool Epoll::modify(int fd, uint32_t events, void *ptr) {
+    epoll_data_t data;
+    data.ptr = ptr;
+    return modify(fd, events, data);
+}
+bool Epoll::modify(int fd, uint32_t events, epoll_data_t data) {
+    if (uring) return uring->modify(fd, events, data);
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data = data;
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
 // Удаление файла/сокета из epoll
 bool Epoll::remove(int fd) {
+    if (uring) return uring->remove(fd);
     return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr) == 0;
 }
 // Ожидание событий epoll
 int Epoll::wait(epoll_event *events, int maxevents, int timeout) {
+    if (uring) return uring->wait(events, maxevents, timeout);
     return epoll_wait(epfd, events, maxevents, timeout);
 }
-#endif
\ No newline at end of file
+#endif
@@ -1,25 +1,71 @@
 #pragma once
+#include <cstdint>
 #ifdef _WIN32
     #include <winsock2.h>
     #include <ws2tcpip.h>
     #include <mswsock.h>
     #include <vector>
+
+    // Минимальная совместимость с <sys/epoll.h> для WSAPoll
+    typedef union epoll_data {
+        void *ptr;
+        int fd;
+        uint32_t u32;
+        uint64_t u64;
+    } epoll_data_t;
+    struct epoll_event {
+        uint32_t events;
+        epoll_data_t data;
+    };
+    enum : uint32_t {
+        EPOLLIN      = 0x001,
+        EPOLLOUT     = 0x004,
+        EPOLLERR     = 0x008,
+        EPOLLHUP     = 0x010,
+        EPOLLRDHUP   = 0x2000,
+        EPOLLONESHOT = 1u << 30,
+        EPOLLET      = 1u << 31
+    };
 #else
     #include <sys/epoll.h>
+    class UringPoller;
 #endif
 
-// Класс-обёртка для работы с epoll на Linux и WSAPoll на Windows
+// Класс-обёртка для работы с epoll на Linux и WSAPoll на Windows.
+// Помимо маски событий (в т.ч. EPOLLET/EPOLLONESHOT/EPOLLRDHUP) с каждым
+// дескриптором можно связать пользовательские данные: fd (по умолчанию),
+// указатель или u64 — они возвращаются в epoll_event::data.
 class Epoll {
 public:
-    Epoll();             // Конструктор инициализации
+    // Механизм ожидания событий. IoUring доступен только на Linux; если ядро
+    // его не поддерживает, используется обычный epoll (см. backend()).
+    enum class Backend { Epoll, IoUring };
+
+    explicit Epoll(Backend requested = Backend::Epoll); // Конструктор инициализации
     ~Epoll();            // Деструктор очистки
-    bool add(int fd, uint32_t events);  // Добавление дескриптора в набор
+    bool add(int fd, uint32_t events);  // Добавление дескриптора в набор (data.fd = fd)
+    bool add(int fd, uint32_t events, void *ptr);          // ... с указателем в data.ptr
+    bool add(int fd, uint32_t events, epoll_data_t data);  // ... с произвольными данными
+    bool modify(int fd, uint32_t events);  // Смена маски событий одним вызовом (EPOLL_CTL_MOD)
+    bool modify(int fd, uint32_t events, void *ptr);
+    bool modify(int fd, uint32_t events, epoll_data_t data);
     bool remove(int fd);               // Удаление дескриптора
     int wait(struct epoll_event *events, int maxevents, int timeout); // Ожидание событий
+    Backend backend() const;           // Фактически используемый механизм
+
+    Epoll(const Epoll &) = delete;
+    Epoll &operator=(const Epoll &) = delete;
 private:
 #ifdef _WIN32
+    struct Entry {
+        uint32_t events;    // исходная маска (для EPOLLONESHOT)
+        epoll_data_t data;
+        bool armed;         // EPOLLONESHOT: событие уже выдано, ждём modify
+    };
     std::vector<WSAPOLLFD> fds; // Список WSAPOLLFD для WSAPoll
+    std::vector<Entry> entries; // Данные пользователя, параллельно fds
 #else
-    int epfd; // Дескриптор epoll
+    int epfd;             // Дескриптор epoll (-1 при работе через io_uring)
+    UringPoller *uring;   // Бэкенд io_uring или nullptr
 #endif
-};
\ No newline at end of file
+};
@@ -0,0 +1,161 @@
+#include "handoff.h"
+#include "logger.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Сообщение старого процесса; дескрипторы идут в SCM_RIGHTS того же sendmsg:
+// сначала слушающие сокеты реакторов, затем (если has_admin) сокет статистики
+struct HandoffHeader {
+    char magic[4];
+    uint32_t listeners;
+    uint32_t has_admin;
+};
+
+const char kHandoffMagic[4] = {'C', 'A', 'L', 'H'};
+const size_t kMaxHandoffFds = 253;   // SCM_MAX_FD
+const char kHandoffAck = 'K';
+const time_t kHandoffTimeoutSec = 10;
+
+sockaddr_un unix_addr(const std::string &path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("handoff path is too long");
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+// Временный путь сокета до handoff_publish: свой у каждого процесса
+std::string temp_path(const std::string &path) {
+    return path + "." + std::to_string(getpid());
+}
+
+void set_timeout(int fd) {
+    timeval tv{kHandoffTimeoutSec, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+} // namespace
+
+int make_handoff_listener(const std::string &path) {
+    std::string tmp = temp_path(path);
+    sockaddr_un addr = unix_addr(tmp);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::runtime_error("handoff socket failed");
+    unlink(tmp.c_str()); // остался от упавшего процесса с тем же pid
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        close(fd);
+        unlink(tmp.c_str());
+        throw std::runtime_error("handoff bind failed");
+    }
+    return fd;
+}
+
+bool handoff_publish(const std::string &path) {
+    std::string tmp = temp_path(path);
+    if (rename(tmp.c_str(), path.c_str()) == 0) return true;
+    LOG_ERROR("[HANDOFF] Cannot move %s to %s: %s", tmp.c_str(), path.c_str(), strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+}
+
+int handoff_take(const std::string &path, std::vector<int> &listeners, int &admin_fd) {
+    sockaddr_un addr = unix_addr(path);
+    int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) throw std::runtime_error("handoff socket failed");
+    if (connect(conn, (sockaddr *)&addr, sizeof(addr)) < 0) {
+        // файла нет или он остался от завершившегося процесса — стартуем с нуля
+        int err = errno;
+        close(conn);
+        if (err == ENOENT || err == ECONNREFUSED) return -1;
+        throw std::runtime_error(std::string("handoff connect: ") + strerror(err));
+    }
+    set_timeout(conn);
+
+    HandoffHeader hdr{};
+    iovec iov{&hdr, sizeof(hdr)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxHandoffFds)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+
+    std::vector<int> fds;
+    for (cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int *p = reinterpret_cast<const int *>(CMSG_DATA(c));
+        fds.insert(fds.end(), p, p + count);
+    }
+    bool ok = n == (ssize_t)sizeof(hdr) && !(msg.msg_flags & MSG_CTRUNC) &&
+              memcmp(hdr.magic, kHandoffMagic, sizeof(kHandoffMagic)) == 0 && hdr.listeners > 0 &&
+              fds.size() == hdr.listeners + (hdr.has_admin ? 1 : 0);
+    if (!ok) {
+        for (int fd : fds) close(fd);
+        close(conn);
+        throw std::runtime_error("handoff: malformed message from the previous process");
+    }
+    listeners.assign(fds.begin(), fds.begin() + hdr.listeners);
+    admin_fd = hdr.has_admin ? fds.back() : -1;
+    return conn;
+}
+
+void handoff_confirm(int conn) {
+    ssize_t w = write(conn, &kHandoffAck, 1);
+    (void)w;
+    close(conn);
+}
+
+bool handoff_give(int handoff_fd, const std::vector<int> &listeners, int admin_fd) {
+    int conn = accept4(handoff_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) return false;
+    std::vector<int> fds(listeners);
+    if (admin_fd >= 0) fds.push_back(admin_fd);
+    if (fds.size() > kMaxHandoffFds) {
+        LOG_WARN("[HANDOFF] Too many sockets to pass: %zu", fds.size());
+        close(conn);
+        return false;
+    }
+    set_timeout(conn);
+
+    HandoffHeader hdr{};
+    memcpy(hdr.magic, kHandoffMagic, sizeof(kHandoffMagic));
+    hdr.listeners = (uint32_t)listeners.size();
+    hdr.has_admin = admin_fd >= 0;
+    iovec iov{&hdr, sizeof(hdr)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxHandoffFds)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(c), fds.data(), sizeof(int) * fds.size());
+    if (sendmsg(conn, &msg, MSG_NOSIGNAL) != (ssize_t)sizeof(hdr)) {
+        LOG_WARN("[HANDOFF] sendmsg: %s", strerror(errno));
+        close(conn);
+        return false;
+    }
+    // без подтверждения (преемник упал или не успел) продолжаем работать сами
+    char ack = 0;
+    ssize_t n = read(conn, &ack, 1);
+    close(conn);
+    if (n != 1 || ack != kHandoffAck) {
+        LOG_WARN("[HANDOFF] Successor did not confirm, keep serving");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Передача слушающих сокетов новому процессу сервера при обновлении без простоя.
+// Старый процесс ждёт преемника на unix-сокете; новый подключается, получает
+// дескрипторы (SCM_RIGHTS) и, когда готов принимать, отправляет подтверждение.
+// Только после него старый процесс перестаёт вызывать accept: очередь
+// установленных соединений принадлежит самому сокету и переходит к новому
+// процессу целиком, так что клиенты не видят отказов.
+
+// Слушающий unix-сокет для преемника. Он создаётся на временном пути рядом с
+// path, а на path появляется только после handoff_publish: до подтверждения
+// передачи path ведёт к прежнему процессу
+int make_handoff_listener(const std::string &path);
+// Переместить сокет преемника на path, заменив файл прежнего процесса
+// (rename атомарен). false — не удалось, временный файл удалён
+bool handoff_publish(const std::string &path);
+
+// Забрать сокеты у процесса, ждущего на path: listeners реакторов и сокет
+// статистики (admin_fd, -1 — его не было). Возвращает соединение для
+// handoff_confirm или -1, если прежнего процесса нет. Ошибки протокола — исключения.
+int handoff_take(const std::string &path, std::vector<int> &listeners, int &admin_fd);
+// Сообщить прежнему процессу, что сокеты приняты; закрывает conn
+void handoff_confirm(int conn);
+
+// Принять преемника на handoff_fd и отдать ему сокеты. true — преемник
+// подтвердил готовность, и процессу пора перестать принимать соединения.
+bool handoff_give(int handoff_fd, const std::vector<int> &listeners, int admin_fd);
@@ -0,0 +1,113 @@
+#include "logger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+
+bool parse_log_level(const std::string &name, LogLevel &level) {
+    static const struct { const char *name; LogLevel level; } names[] = {
+        {"trace", LogLevel::Trace}, {"debug", LogLevel::Debug}, {"info", LogLevel::Info},
+        {"warn", LogLevel::Warn}, {"error", LogLevel::Error}, {"off", LogLevel::Off},
+    };
+    for (const auto &n : names) {
+        if (name == n.name) {
+            level = n.level;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *level_tag(LogLevel level) {
+    switch (level) {
+        case LogLevel::Trace: return "TRACE";
+        case LogLevel::Debug: return "DEBUG";
+        case LogLevel::Info:  return "INFO ";
+        case LogLevel::Warn:  return "WARN ";
+        default:              return "ERROR";
+    }
+}
+
+Logger &Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : slots_(new Slot[kSlots]) {
+    for (size_t i = 0; i < kSlots; ++i) slots_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+Logger::~Logger() {
+    stop();
+    delete[] slots_;
+}
+
+void Logger::start() {
+    bool expected = false;
+    if (!running_.compare_exchange_strong(expected, true)) return;
+    worker_ = std::thread(&Logger::drain_loop, this);
+}
+
+void Logger::stop() {
+    bool expected = true;
+    if (running_.compare_exchange_strong(expected, false) && worker_.joinable()) worker_.join();
+    drain();
+}
+
+void Logger::write(LogLevel level, const char *fmt, ...) {
+    // Захват ячейки: классическая ограниченная MPMC-очередь
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots_[pos & (kSlots - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            dropped_.fetch_add(1, std::memory_order_relaxed); // буфер полон
+            return;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(slot->text, kTextSize, fmt, ap);
+    va_end(ap);
+    if (n < 0) n = 0;
+    slot->len = (uint16_t)(n < (int)kTextSize ? n : (int)kTextSize - 1);
+    slot->level = level;
+    slot->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+size_t Logger::drain() {
+    size_t count = 0;
+    char line[kTextSize + 64];
+    while (true) {
+        Slot &slot = slots_[dequeue_pos_ & (kSlots - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != dequeue_pos_ + 1) break;
+        time_t sec = (time_t)(slot.time_us / 1000000);
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        int n = snprintf(line, sizeof(line), "%02d:%02d:%02d.%06d %s %.*s\n",
+                         tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(slot.time_us % 1000000),
+                         level_tag(slot.level), (int)slot.len, slot.text);
+        FILE *out = slot.level >= LogLevel::Warn ? stderr : stdout;
+        fwrite(line, 1, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1, out);
+        slot.seq.store(dequeue_pos_ + kSlots, std::memory_order_release);
+        ++dequeue_pos_;
+        ++count;
+    }
+    if (count) fflush(stdout);
+    return count;
+}
+
+void Logger::drain_loop() {
+    // Пока сообщений нет, поток спит; при потоке сообщений выводит их пачками
+    while (running_.load(std::memory_order_acquire)) {
+        if (drain() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
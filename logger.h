@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#if defined(__GNUC__)
+#define LOG_PRINTF_FORMAT(fmt_idx, args_idx) __attribute__((format(printf, fmt_idx, args_idx)))
+#else
+#define LOG_PRINTF_FORMAT(fmt_idx, args_idx)
+#endif
+
+// Уровни журнала по возрастанию важности
+enum class LogLevel { Trace, Debug, Info, Warn, Error, Off };
+
+// "trace", "debug", "info", "warn", "error", "off"
+bool parse_log_level(const std::string &name, LogLevel &level);
+
+// Асинхронный журнал. Потоки-производители форматируют сообщение прямо в ячейку
+// кольцевого буфера без блокировок (ограниченная MPMC-очередь Вьюкова), а фоновый
+// поток пачками выводит накопленное в stdout (Warn и Error — в stderr).
+// Если буфер заполнен, сообщение отбрасывается и учитывается в dropped():
+// журнал никогда не тормозит обработку запросов.
+class Logger {
+public:
+    static Logger &instance();
+
+    void start();  // Запуск фонового потока
+    void stop();   // Вывод всего накопленного и остановка потока
+
+    void set_level(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+    void write(LogLevel level, const char *fmt, ...) LOG_PRINTF_FORMAT(3, 4);
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+private:
+    static const size_t kSlots = 4096;      // степень двойки
+    static const size_t kTextSize = 240;
+
+    struct Slot {
+        std::atomic<size_t> seq;
+        LogLevel level;
+        uint16_t len;
+        int64_t time_us;
+        char text[kTextSize];
+    };
+
+    Logger();
+    ~Logger();
+    void drain_loop();
+    size_t drain();  // вывести всё, что есть; возвращает число сообщений
+
+    std::atomic<LogLevel> level_{LogLevel::Info};
+    std::atomic<uint64_t> dropped_{0};
+    Slot *slots_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) size_t dequeue_pos_ = 0;    // только фоновый поток
+    std::atomic<bool> running_{false};
+    std::thread worker_;
+};
+
+// Проверка уровня до форматирования: выключенные сообщения ничего не стоят
+#define LOG_AT(level, ...) \
+    do { \
+        if (Logger::instance().enabled(level)) Logger::instance().write(level, __VA_ARGS__); \
+    } while (0)
+#define LOG_TRACE(...) LOG_AT(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,139 @@
+#include "metrics.h"
+#include "logger.h"
+#include <chrono>
+#include <cstdio>
+
+uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int LatencyHistogram::bucket_of(uint64_t value) {
+    if (value < (uint64_t)kSub) return (int)value;
+    int e = 63 - __builtin_clzll(value);            // старший бит, e >= kSubBits
+    int sub = (int)(value >> (e - kSubBits)) & (kSub - 1);
+    return (e - kSubBits + 1) * kSub + sub;
+}
+
+uint64_t LatencyHistogram::bucket_upper(int idx) {
+    if (idx < kSub) return (uint64_t)idx;
+    int e = idx / kSub + kSubBits - 1;
+    uint64_t sub = (uint64_t)(idx % kSub);
+    uint64_t width = 1ULL << (e - kSubBits);
+    return ((kSub + sub) << (e - kSubBits)) + width - 1;
+}
+
+void LatencyHistogram::merge_into(std::vector<uint64_t> &acc) const {
+    acc.resize(kBuckets);
+    for (int i = 0; i < kBuckets; ++i) acc[i] += buckets_[i].get();
+}
+
+uint64_t histogram_quantile(const std::vector<uint64_t> &buckets, double q) {
+    uint64_t total = 0;
+    for (uint64_t b : buckets) total += b;
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen > rank) return LatencyHistogram::bucket_upper((int)i);
+    }
+    return LatencyHistogram::bucket_upper((int)buckets.size() - 1);
+}
+
+ReactorMetrics &MetricsRegistry::add_reactor() {
+    reactors_.emplace_back(new ReactorMetrics);
+    return *reactors_.back();
+}
+
+// Счётчик с разбивкой по реакторам
+static void render_counter(std::string &out, const char *name, const char *help, const char *type,
+                           const std::vector<std::unique_ptr<ReactorMetrics>> &reactors,
+                           Counter ReactorMetrics::*field) {
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    out += line;
+    for (size_t i = 0; i < reactors.size(); ++i) {
+        snprintf(line, sizeof(line), "%s{reactor=\"%zu\"} %llu\n", name, i,
+                 (unsigned long long)((*reactors[i]).*field).get());
+        out += line;
+    }
+}
+
+std::string MetricsRegistry::render_prometheus() const {
+    std::string out;
+    out.reserve(4096);
+    render_counter(out, "calc_connections_accepted_total", "Accepted connections", "counter",
+                   reactors_, &ReactorMetrics::accepted);
+    render_counter(out, "calc_connections_active", "Open connections", "gauge",
+                   reactors_, &ReactorMetrics::active);
+    render_counter(out, "calc_requests_completed_total", "Evaluated requests", "counter",
+                   reactors_, &ReactorMetrics::completed);
+    render_counter(out, "calc_parse_errors_total", "Requests answered with ERROR", "counter",
+                   reactors_, &ReactorMetrics::parse_errors);
+    render_counter(out, "calc_read_eagain_total", "read() calls that returned EAGAIN", "counter",
+                   reactors_, &ReactorMetrics::read_eagain);
+    render_counter(out, "calc_write_eagain_total", "write() calls that returned EAGAIN", "counter",
+                   reactors_, &ReactorMetrics::write_eagain);
+    render_counter(out, "calc_bytes_in_total", "Bytes received from clients", "counter",
+                   reactors_, &ReactorMetrics::bytes_in);
+    render_counter(out, "calc_bytes_out_total", "Bytes sent to clients", "counter",
+                   reactors_, &ReactorMetrics::bytes_out);
+    render_counter(out, "calc_cache_hits_total", "Responses served from the result cache", "counter",
+                   reactors_, &ReactorMetrics::cache_hits);
+    render_counter(out, "calc_cache_misses_total", "Cacheable requests that were evaluated", "counter",
+                   reactors_, &ReactorMetrics::cache_misses);
+    render_counter(out, "calc_cache_evictions_total", "Result cache entries evicted by the memory cap",
+                   "counter", reactors_, &ReactorMetrics::cache_evictions);
+    render_counter(out, "calc_cache_bytes", "Estimated result cache memory", "gauge",
+                   reactors_, &ReactorMetrics::cache_bytes);
+    render_counter(out, "calc_offloaded_total", "Requests evaluated on the worker pool", "counter",
+                   reactors_, &ReactorMetrics::offloaded);
+    render_counter(out, "calc_connections_rejected_total", "Connections reset over the --max-conns limit",
+                   "counter", reactors_, &ReactorMetrics::rejected);
+    render_counter(out, "calc_connections_timed_out_total", "Connections closed by idle/read/write deadlines",
+                   "counter", reactors_, &ReactorMetrics::timeouts);
+    render_counter(out, "calc_buffer_pool_bytes", "Memory held by reactor buffer pools (used and free blocks)",
+                   "gauge", reactors_, &ReactorMetrics::buffer_bytes);
+    render_counter(out, "calc_busy_poll_sleeps_total", "Times a busy-polling reactor went idle and switched to blocking waits",
+                   "counter", reactors_, &ReactorMetrics::busy_sleeps);
+
+    // Гистограммы реакторов сливаются и отдаются как summary с квантилями
+    static const struct { const char *stage; LatencyHistogram ReactorMetrics::*field; } stages[] = {
+        {"accept_to_first_byte", &ReactorMetrics::accept_to_first_byte},
+        {"last_byte_to_result", &ReactorMetrics::last_byte_to_result},
+        {"result_to_sent", &ReactorMetrics::result_to_sent},
+    };
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    char line[256];
+    out += "# HELP calc_stage_latency_seconds Request processing stage latency\n"
+           "# TYPE calc_stage_latency_seconds summary\n";
+    for (const auto &st : stages) {
+        std::vector<uint64_t> acc(LatencyHistogram::kBuckets, 0);
+        uint64_t count = 0, sum = 0;
+        for (const auto &r : reactors_) {
+            const LatencyHistogram &h = (*r).*(st.field);
+            h.merge_into(acc);
+            count += h.count();
+            sum += h.sum();
+        }
+        for (double q : quantiles) {
+            snprintf(line, sizeof(line), "calc_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                     st.stage, q, (double)histogram_quantile(acc, q) * 1e-9);
+            out += line;
+        }
+        snprintf(line, sizeof(line),
+                 "calc_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n"
+                 "calc_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+                 st.stage, (double)sum * 1e-9, st.stage, (unsigned long long)count);
+        out += line;
+    }
+    snprintf(line, sizeof(line),
+             "# HELP calc_log_dropped_total Log messages dropped because the ring buffer was full\n"
+             "# TYPE calc_log_dropped_total counter\n"
+             "calc_log_dropped_total %llu\n",
+             (unsigned long long)Logger::instance().dropped());
+    out += line;
+    return out;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Монотонное время в наносекундах
+uint64_t now_ns();
+
+// Счётчик с единственным писателем (поток реактора): увеличение — это обычные
+// load+store без lock-префикса, читатели (поток статистики) видят значение через
+// relaxed-загрузку, поэтому учёт не создаёт конкуренции между ядрами.
+class Counter {
+public:
+    void add(uint64_t n = 1) { v_.store(v_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void sub(uint64_t n = 1) { v_.store(v_.load(std::memory_order_relaxed) - n, std::memory_order_relaxed); }
+    uint64_t get() const { return v_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<uint64_t> v_{0};
+};
+
+// Гистограмма задержек в стиле HDR: 16 линейных корзин на каждую степень двойки,
+// т.е. относительная погрешность не больше 1/16 на всём диапазоне uint64.
+// Писатель один (реактор), снимки можно брать из любого потока.
+class LatencyHistogram {
+public:
+    static const int kSubBits = 4;
+    static const int kSub = 1 << kSubBits;
+    static const int kBuckets = (64 - kSubBits + 1) * kSub;
+
+    void record(uint64_t value) {
+        Counter &b = buckets_[bucket_of(value)];
+        b.add();
+        count_.add();
+        sum_.add(value);
+    }
+    uint64_t count() const { return count_.get(); }
+    uint64_t sum() const { return sum_.get(); }
+
+    static int bucket_of(uint64_t value);
+    static uint64_t bucket_upper(int idx); // наибольшее значение, попадающее в корзину
+
+    // Прибавить содержимое к накопителю (kBuckets элементов)
+    void merge_into(std::vector<uint64_t> &acc) const;
+private:
+    Counter buckets_[kBuckets];
+    Counter count_;
+    Counter sum_;
+};
+
+// Квантиль q (0..1) по накопленным корзинам; 0, если значений нет
+uint64_t histogram_quantile(const std::vector<uint64_t> &buckets, double q);
+
+// Метрики одного реактора. Выравнивание исключает ложное разделение
+// кэш-линий между реакторами.
+struct alignas(64) ReactorMetrics {
+    Counter accepted;        // принятые соединения
+    Counter active;          // открытые сейчас соединения
+    Counter completed;       // вычисленные запросы
+    Counter parse_errors;    // запросы с ответом ERROR
+    Counter read_eagain;     // read() вернул EAGAIN
+    Counter write_eagain;    // write() вернул EAGAIN (клиент не успевает читать)
+    Counter bytes_in;
+    Counter bytes_out;
+    Counter cache_hits;      // ответы, взятые из кэша
+    Counter cache_misses;    // выражения, вычисленные и добавленные в кэш
+    Counter cache_evictions; // записи, вытесненные из кэша по лимиту памяти
+    Counter cache_bytes;     // занятая кэшем память (оценка)
+    Counter offloaded;       // запросы, вычисленные в пуле потоков
+    Counter rejected;        // соединения, сброшенные сверх лимита --max-conns
+    Counter timeouts;        // соединения, закрытые по истечении срока
+    Counter buffer_bytes;    // память пула буферов реактора (занятые и свободные блоки)
+    Counter busy_sleeps;     // переходы busy-poll от опроса к блокирующему ожиданию
+    LatencyHistogram accept_to_first_byte; // от accept до первого байта запроса
+    LatencyHistogram last_byte_to_result;  // от последнего байта запроса до готового ответа
+    LatencyHistogram result_to_sent;       // от готового ответа до его полной отправки
+};
+
+// Все метрики процесса; реакторы регистрируются до запуска потоков
+class MetricsRegistry {
+public:
+    ReactorMetrics &add_reactor();
+    // Текстовый формат Prometheus (exposition format 0.0.4)
+    std::string render_prometheus() const;
+private:
+    std::vector<std::unique_ptr<ReactorMetrics>> reactors_;
+};
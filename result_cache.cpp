@@ -0,0 +1,46 @@
+#include "result_cache.h"
+
+static bool is_operator(char c) {
+    return c == '+' || c == '-' || c == '*' || c == '/' || c == '(' || c == ')';
+}
+
+void normalize_expr(std::string_view raw, std::string &out) {
+    out.clear();
+    bool space = false; // перед текущим символом были пробелы
+    for (char c : raw) {
+        if (c == ' ') {
+            space = true;
+            continue;
+        }
+        if (space && !out.empty() && !is_operator(c) && !is_operator(out.back()))
+            out += ' ';
+        space = false;
+        out += c;
+    }
+}
+
+const std::string *ResultCache::find(std::string_view key) {
+    auto it = map_.find(key);
+    if (it == map_.end()) return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->response;
+}
+
+size_t ResultCache::insert(std::string_view key, std::string_view response) {
+    if (map_.count(key)) return 0;
+    Entry e{std::string(key), std::string(response)};
+    size_t c = cost(e);
+    if (c > max_bytes_) return 0;
+    size_t evicted = 0;
+    while (bytes_ + c > max_bytes_ && !lru_.empty()) {
+        const Entry &old = lru_.back();
+        bytes_ -= cost(old);
+        map_.erase(old.key);
+        lru_.pop_back();
+        ++evicted;
+    }
+    lru_.push_front(std::move(e));
+    map_.emplace(lru_.front().key, lru_.begin());
+    bytes_ += c;
+    return evicted;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Приведение выражения к каноническому виду для ключа кэша: пробелы по краям и
+// рядом с операторами и скобками убираются, серии пробелов между прочими
+// символами сжимаются до одного. Результат вычисления от этого не меняется
+// ("1 2" остаётся ошибкой, а не превращается в 12).
+void normalize_expr(std::string_view raw, std::string &out);
+
+// LRU-кэш ответов: ключ — нормализованное выражение, значение — готовые байты
+// ответа (число или "ERROR"). Не потокобезопасен, у каждого реактора свой
+// экземпляр, поэтому поиск никогда не ждёт блокировок.
+class ResultCache {
+public:
+    explicit ResultCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    // nullptr — промах; найденная запись становится самой свежей
+    const std::string *find(std::string_view key);
+    // Добавить запись, вытеснив самые старые сверх лимита памяти.
+    // Возвращает число вытесненных записей.
+    size_t insert(std::string_view key, std::string_view response);
+
+    size_t bytes() const { return bytes_; }   // оценка занятой памяти
+    size_t size() const { return map_.size(); }
+private:
+    struct Entry {
+        std::string key;
+        std::string response;
+    };
+    // Накладные расходы на запись сверх самих строк: узлы списка и хеш-таблицы
+    static const size_t kEntryOverhead = 128;
+    static size_t cost(const Entry &e) { return e.key.size() + e.response.size() + kEntryOverhead; }
+
+    size_t max_bytes_;
+    size_t bytes_ = 0;
+    std::list<Entry> lru_;   // в начале — самые свежие
+    // ключи указывают на строки внутри узлов списка, адреса которых стабильны
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> map_;
+};
@@ -1,178 +1,1098 @@
 #include "epoll_wrapper.h"
-#include <iostream>
+#include "calc_core.h"
+#include "binary_proto.h"
+#include "buffer_pool.h"
+#include "capture.h"
+#include "handoff.h"
+#include "logger.h"
+#include "metrics.h"
+#include "result_cache.h"
+#include "timer_wheel.h"
+#include "server.h"
+#include <algorithm>
+#include <deque>
 #include <string>
-#include <unordered_map>
+#include <memory>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <cerrno>
 #include <stdexcept>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/signalfd.h>
+#include <arpa/inet.h>
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// Общий заголовок всего, что реактор регистрирует в epoll. Указатель на него
+// кладётся в epoll_event::data.ptr, так что обработчик события находится сразу,
+// без поиска по таблице.
+struct EventSlot {
+    enum Kind { Listener, Client, Wakeup };
+    int fd = -1;
+    Kind kind = Client;
+};
+
+struct ClientSession : EventSlot {
+    explicit ClientSession(BufferPool &pool) : held(pool), out(pool) {}
+
+    enum class Proto { Unknown, Text, Binary }; // определяется по первому байту
+    Proto proto = Proto::Unknown;
+    BinaryDecoder bin;         // состояние разбора двоичных кадров
+    StreamEvaluator eval;      // выражение вычисляется по мере чтения
+    size_t recv_bytes = 0;     // сколько байт текущего выражения уже получено
+    BlockChain held;           // начало выражения, придержанное до проверки кэша или пула
+    bool streaming = false;    // выражение не помещается в кэш и идёт прямо в eval
+    BlockChain out;            // ответы, ожидающие отправки (по порядку запросов)
+    bool peer_closed = false;  // клиент завершил передачу (EOF)
+    bool shut = false;         // при завершении процесса отправлен FIN, ввод отбрасывается
+    uint32_t events = 0;       // маска, с которой fd сейчас зарегистрирован в epoll
+    // Отметки времени для метрик (now_ns)
+    uint64_t accepted_ns = 0;  // момент accept; 0 — первый байт уже получен
+    uint64_t unsent_ns = 0;    // когда был готов самый старый неотправленный ответ
+    uint64_t gen = 0;          // поколение сессии: ответы пула для прежнего владельца fd отбрасываются
+
+    // Сроки (мс, часы реактора): проверяются колесом таймеров
+    TimerNode timer;
+    uint64_t active_ms = 0;    // последний принятый байт (или accept)
+    uint64_t request_ms = 0;   // начало незавершённого запроса; 0 — запроса нет
+    uint64_t write_ms = 0;     // последняя успешная запись при непустой очереди; 0 — очередь пуста
+
+    // Запрос, отданный в пул, задерживает все ответы после себя: они копятся здесь
+    // по порядку и переходят в out, когда готовы все предшествующие
+    struct Awaiting {
+        uint64_t seq;          // номер задачи пула (для готовых ответов не используется)
+        bool done;
+        bool newline;          // дописать '\n' к ответу задачи
+        std::string bytes;
+    };
+    std::deque<Awaiting> awaiting;
+    size_t awaiting_bytes = 0;
+    uint64_t next_seq = 0;
+};
 
-// Функции парсинга с учётом приоритета операций
-class ExprParser {
-    const std::string &s;
-    size_t i;
+// Таблица сессий, индексированная номером дескриптора. Ядро выдаёт наименьшие
+// свободные номера, поэтому таблица плотная; ячейки переиспользуются, а адреса
+// сессий стабильны. Буферы при закрытии возвращаются в пул реактора.
+class SessionSlab {
 public:
-    ExprParser(const std::string &str) : s(str), i(0) {}
-    double parse() {
-        double res = parseExpression();
-        skipSpaces();
-        if (i != s.size()) throw std::runtime_error("Unexpected chars at end");
-        return res;
+    explicit SessionSlab(BufferPool &pool) : pool_(pool) {}
+
+    ClientSession *acquire(int fd) {
+        if ((size_t)fd >= slots_.size()) slots_.resize(fd + 1);
+        auto &slot = slots_[fd];
+        if (!slot) {
+            slot.reset(new ClientSession(pool_));
+            slot->timer.owner = slot.get();
+        }
+        ClientSession *sess = slot.get();
+        sess->fd = fd;
+        sess->proto = ClientSession::Proto::Unknown;
+        sess->bin.reset();
+        sess->eval.reset();
+        sess->recv_bytes = 0;
+        sess->streaming = false;
+        sess->peer_closed = false;
+        sess->shut = false;
+        sess->events = 0;
+        sess->accepted_ns = 0;
+        sess->unsent_ns = 0;
+        sess->gen = ++gen_;
+        sess->active_ms = 0;
+        sess->request_ms = 0;
+        sess->write_ms = 0;
+        sess->awaiting.clear();
+        sess->awaiting_bytes = 0;
+        sess->next_seq = 0;
+        ++active_;
+        return sess;
+    }
+    void release(ClientSession *sess) {
+        sess->held.clear();
+        sess->out.clear();
+        sess->awaiting.clear();
+        sess->awaiting_bytes = 0;
+        sess->streaming = false;
+        sess->peer_closed = false;
+        sess->fd = -1;
+        --active_;
+    }
+    size_t active() const { return active_; }
+    // Открытая сессия для fd или nullptr
+    ClientSession *find(int fd) {
+        if (fd < 0 || (size_t)fd >= slots_.size() || !slots_[fd] || slots_[fd]->fd != fd) return nullptr;
+        return slots_[fd].get();
+    }
+    template <class Fn> void for_each(Fn fn) {
+        for (auto &slot : slots_)
+            if (slot && slot->fd >= 0) fn(*slot);
     }
 private:
-    void skipSpaces() {
-        while (i < s.size() && s[i] == ' ') ++i;
-    }
-    double parseNumber() {
-        skipSpaces();
-        size_t start = i;
-        while (i < s.size() && (isdigit(s[i]) || s[i]=='.')) ++i;
-        if (start == i) throw std::runtime_error("Number expected");
-        return std::stod(s.substr(start, i - start));
-    }
-    double parseFactor() {
-        skipSpaces();
-        if (s[i] == '(') {
-            ++i;
-            double v = parseExpression();
-            skipSpaces();
-            if (s[i] != ')') throw std::runtime_error("')' expected");
-            ++i;
-            return v;
-        }
-        return parseNumber();
-    }
-    double parseTerm() {
-        double lhs = parseFactor();
-        while (true) {
-            skipSpaces();
-            if (i >= s.size()) break;
-            char op = s[i];
-            if (op!='*' && op!='/') break;
-            ++i;
-            double rhs = parseFactor();
-            if (op == '*') lhs *= rhs;
-            else {
-                if (rhs == 0) throw std::runtime_error("Division by zero");
-                lhs /= rhs;
-            }
+    BufferPool &pool_;
+    std::vector<std::unique_ptr<ClientSession>> slots_;
+    size_t active_ = 0;
+    uint64_t gen_ = 0;
+};
+
+// Клиентские сокеты работают по фронту: читаем и пишем до EAGAIN
+static const uint32_t kClientEvents = EPOLLET | EPOLLRDHUP;
+
+// Буферы реактора — блоки по 4 КиБ из его пула. Свободных блоков пул держит
+// не больше kMaxFreeBlocks (1 МиБ), остальное возвращает системе.
+static const size_t kBufferBlockSize = 4096;
+static const size_t kMaxFreeBlocks = 256;
+// Чтение одним readv прямо в блоки пула, до ~32 КиБ за вызов
+static const int kReadBlocks = 8;
+// Отправка одним writev не больше чем из стольких блоков очереди
+static const int kWriteBlocks = 16;
+// Буфер записи трафика уходит в файл не реже чем раз в столько мс
+static const uint64_t kCaptureFlushMs = 100;
+
+// Состояние реактора, нужное обработчикам его соединений
+struct Reactor {
+    int id;
+    const ServerConfig &cfg;
+    ReactorMetrics &metrics;
+    ReactorControl &control;
+    WorkPool *pool;                     // nullptr — всё вычисляется в реакторе
+    std::unique_ptr<ResultCache> cache; // nullptr — кэш выключен
+    std::string cache_key;              // буфер для нормализованного ключа
+    uint64_t now_ms;                    // часы реактора, обновляются после каждого wait
+    TimerWheel timers;                  // сроки чтения, простоя и записи соединений
+    size_t max_conns;                   // лимит соединений на все реакторы (0 — без лимита)
+    int busy_poll_us;                   // SO_BUSY_POLL для новых соединений (0 — не ставить)
+    BufferPool buffers;                 // блоки буферов приёма и отправки всех соединений
+    BufferBlock *rx[kReadBlocks] = {};  // окно чтения: сюда readv кладёт данные любого соединения
+    ExprCompiler compiler{};            // байткод форм выражений, придержанных целиком
+    size_t buffer_bytes = 0;            // объём пула, уже учтённый в metrics.buffer_bytes
+    bool draining = false;              // сокеты переданы преемнику, ждём закрытия соединений
+    uint64_t drain_start_ms = 0;
+    uint64_t drain_deadline_ms = 0;     // когда закрыть оставшиеся принудительно (0 — никогда)
+    std::unique_ptr<CaptureBuffer> capture{}; // запись трафика (--record), nullptr — выключена
+    uint64_t capture_flush_ms = 0;          // когда буфер записи последний раз сброшен в файл
+    TimerNode accept_retry{};               // возобновление accept после нехватки дескрипторов
+    bool accept_paused = false;             // слушающий сокет снят с epoll до accept_retry
+    uint64_t accept_warn_ms = 0;            // когда ошибка accept4 последний раз попала в журнал
+    uint64_t accept_warn_skipped = 0;       // сколько ошибок с тех пор не записано
+    size_t held_bytes = 0;                  // придержано байт выражений во всех сессиях реактора
+    size_t held_budget = 0;                 // предел held_bytes; сверх него выражения идут потоково
+    std::atomic<size_t> *conns = nullptr;   // открытые соединения всех реакторов (при max_conns)
+};
+
+// Выражения длиннее этого в кэш не попадают: их байты не придерживаются,
+// а сразу вычисляются по мере прихода
+static const size_t kMaxCachedExpr = 512;
+static_assert(kMaxCachedExpr <= kBufferBlockSize - sizeof(BufferBlock),
+              "cacheable expression must fit into one buffer block");
+
+// Если неотправленных ответов больше этого порога, сервер перестаёт читать
+// новые запросы соединения, пока клиент не заберёт ответы
+static const size_t kMaxPendingOutput = 64 * 1024;
+
+// Колесо таймеров: тик 100 мс, оборот ~100 с (сроки длиннее тоже работают)
+static const uint64_t kTimerTickMs = 100;
+static const size_t kTimerSlots = 1024;
+
+// Сколько ответов соединения может ждать пула (вместе с готовыми ответами за
+// ними), прежде чем чтение новых запросов приостановится
+static const size_t kMaxAwaiting = 16;
+
+static bool output_full(const ClientSession &sess) {
+    return sess.out.size() + sess.awaiting_bytes >= kMaxPendingOutput ||
+           sess.awaiting.size() >= kMaxAwaiting;
+}
+
+// Освободить придержанные байты сессии с учётом в бюджете реактора
+static void drop_held(Reactor &r, ClientSession &sess) {
+    r.held_bytes -= sess.held.size();
+    sess.held.clear();
+}
+
+// Придержанное начало выражения — в вычислитель, блок за блоком без склейки
+static void feed_held(ClientSession &sess) {
+    for (const BufferBlock *b = sess.held.front(); b; b = b->next)
+        sess.eval.feed(b->data() + b->begin, b->end - b->begin);
+}
+
+// Очередной фрагмент выражения. При включённом кэше короткое выражение
+// придерживается целиком, чтобы при попадании вообще не разбирать его; как только
+// оно перерастает kMaxCachedExpr, накопленное уходит в вычислитель. С пулом
+// придерживается до cfg.offload_hold_bytes (но не меньше порога выгрузки): размер
+// выражения известен только в конце. Сверх бюджета реактора тоже считаем потоково.
+static void feed_expr(Reactor &r, ClientSession &sess, const char *data, size_t len) {
+    sess.recv_bytes += len;
+    size_t hold = r.pool ? std::max(r.cfg.offload_bytes, r.cfg.offload_hold_bytes)
+                         : r.cache ? kMaxCachedExpr : 0;
+    if (sess.streaming) {
+        sess.eval.feed(data, len);
+        return;
+    }
+    if (sess.held.size() + len <= hold && (!r.pool || r.held_bytes + len <= r.held_budget)) {
+        sess.held.append(data, len);
+        r.held_bytes += len;
+        return;
+    }
+    feed_held(sess);
+    sess.eval.feed(data, len);
+    drop_held(r, sess);
+    sess.streaming = true;
+}
+
+// Ответ на выражение (число или "ERROR") в out, не больше kResultBufSize байт;
+// возвращает длину
+static size_t result_text(Reactor &r, bool ok, double res, char *out) {
+    if (ok) return format_result(res, out);
+    r.metrics.parse_errors.add();
+    memcpy(out, "ERROR", 5);
+    return 5;
+}
+
+// Ответ потокового вычислителя
+static size_t eval_result(Reactor &r, ClientSession &sess, char *out) {
+    double res;
+    bool ok = sess.eval.finish(res);
+    return result_text(r, ok, res, out);
+}
+
+// Ответ на придержанное выражение. Лежащее в одном блоке вычисляется байткодом
+// своей формы: у запросов одной структуры он компилируется один раз
+static size_t eval_held(Reactor &r, ClientSession &sess, char *out) {
+    const BufferBlock *b = sess.held.front();
+    if (b && !b->next) {
+        double res;
+        bool ok = r.compiler.evaluate(std::string_view(b->data() + b->begin, b->end - b->begin), res);
+        return result_text(r, ok, res, out);
+    }
+    feed_held(sess);
+    return eval_result(r, sess, out);
+}
+
+// Подготовка сессии к следующему выражению
+static void reset_request(Reactor &r, ClientSession &sess) {
+    sess.request_ms = 0;
+    sess.eval.reset();
+    sess.recv_bytes = 0;
+    drop_held(r, sess);
+    sess.streaming = false;
+}
+
+// Отдать придержанное выражение в пул. Ответ вернётся через control.post()
+// и будет доставлен deliver_offloaded.
+static void offload_request(Reactor &r, ClientSession &sess, bool newline, uint64_t last_byte_ns) {
+    uint64_t seq = sess.next_seq++;
+    sess.awaiting.push_back({seq, false, newline, {}});
+    r.metrics.offloaded.add();
+    OffloadResult job{sess.fd, sess.gen, seq, last_byte_ns, false, 0};
+    // блоки принадлежат пулу реактора, поэтому пулу потоков отдаётся копия —
+    // одно выделение точно по размеру выражения
+    std::string expr;
+    sess.held.copy_to(expr);
+    WorkPool &pool = *r.pool;
+    ReactorControl &control = r.control;
+    pool.submit([&pool, &control, job, expr = std::move(expr)]() mutable {
+        job.ok = evaluate_parallel(pool, expr, job.value);
+        control.post(job);
+    });
+    reset_request(r, sess);
+}
+
+// Номер соединения в записи трафика: поколение сессии уникально внутри реактора
+static uint64_t capture_conn(const Reactor &r, const ClientSession &sess) {
+    return sess.gen * (uint64_t)std::max(r.cfg.threads, 1) + (uint64_t)r.id;
+}
+
+// Байты ответа в очередь отправки — в том порядке, в каком их получит клиент
+static void queue_output(Reactor &r, ClientSession &sess, const char *data, size_t len) {
+    sess.out.append(data, len);
+    if (r.capture) r.capture->record(CaptureEvent::Out, now_ns(), capture_conn(r, sess), data, len);
+}
+
+// Ответ в очередь отправки. Пока есть не готовые ответы пула, всё
+// последующее придерживается за ними, чтобы сохранить порядок
+static void emit_reply(Reactor &r, ClientSession &sess, const char *data, size_t len) {
+    if (sess.awaiting.empty()) {
+        queue_output(r, sess, data, len);
+        return;
+    }
+    if (sess.awaiting.back().done) sess.awaiting.back().bytes.append(data, len);
+    else sess.awaiting.push_back({0, true, false, std::string(data, len)});
+    sess.awaiting_bytes += len;
+}
+
+// Ответ пула пришёл: ставим его на место и переносим в out всё, что
+// теперь готово по порядку
+static void deliver_offloaded(Reactor &r, ClientSession &sess, const OffloadResult &res) {
+    for (auto &a : sess.awaiting) {
+        if (a.done || a.seq != res.seq) continue;
+        if (res.ok) {
+            char out[kResultBufSize];
+            a.bytes.assign(out, format_result(res.value, out));
+        } else {
+            a.bytes = "ERROR";
+            r.metrics.parse_errors.add();
         }
-        return lhs;
+        if (a.newline) a.bytes += '\n';
+        a.done = true;
+        sess.awaiting_bytes += a.bytes.size();
+        break;
+    }
+    uint64_t now = now_ns();
+    r.metrics.completed.add();
+    r.metrics.last_byte_to_result.record(now - res.last_byte_ns);
+    bool moved = false;
+    while (!sess.awaiting.empty() && sess.awaiting.front().done) {
+        queue_output(r, sess, sess.awaiting.front().bytes.data(), sess.awaiting.front().bytes.size());
+        sess.awaiting_bytes -= sess.awaiting.front().bytes.size();
+        sess.awaiting.pop_front();
+        moved = true;
     }
-    double parseExpression() {
-        double lhs = parseTerm();
-        while (true) {
-            skipSpaces();
-            if (i >= s.size()) break;
-            char op = s[i];
-            if (op!='+' && op!='-') break;
-            ++i;
-            double rhs = parseTerm();
-            if (op == '+') lhs += rhs;
-            else lhs -= rhs;
+    if (moved && sess.unsent_ns == 0) sess.unsent_ns = now;
+}
+
+// Выражение закончилось: добавляем ответ в очередь отправки и готовим вычислитель
+// к следующему. В режиме keep-alive ответ завершается '\n'.
+// last_byte_ns — момент чтения фрагмента, завершившего выражение.
+static void complete_request(Reactor &r, ClientSession &sess, bool newline, uint64_t last_byte_ns) {
+    LOG_TRACE("[CLIENT fd=%d] Expr received (%zu bytes)", sess.fd, sess.recv_bytes);
+    bool cacheable = r.cache && !sess.streaming && sess.held.size() <= kMaxCachedExpr;
+    if (!cacheable && r.pool && !sess.streaming && sess.held.size() >= r.cfg.offload_bytes) {
+        offload_request(r, sess, newline, last_byte_ns);
+        return;
+    }
+    char out[kResultBufSize + 1];
+    size_t len;
+    if (cacheable) {
+        // выражение не длиннее kMaxCachedExpr всегда лежит в одном блоке
+        const BufferBlock *b = sess.held.front();
+        normalize_expr(std::string_view(b->data() + b->begin, b->end - b->begin), r.cache_key);
+        if (const std::string *hit = r.cache->find(r.cache_key)) {
+            len = hit->size();
+            memcpy(out, hit->data(), len);
+            r.metrics.cache_hits.add();
+            if (*hit == "ERROR") r.metrics.parse_errors.add();
+        } else {
+            len = eval_held(r, sess, out);
+            size_t before = r.cache->bytes();
+            size_t evicted = r.cache->insert(r.cache_key, std::string_view(out, len));
+            r.metrics.cache_misses.add();
+            r.metrics.cache_evictions.add(evicted);
+            size_t after = r.cache->bytes();
+            if (after >= before) r.metrics.cache_bytes.add(after - before);
+            else r.metrics.cache_bytes.sub(before - after);
         }
-        return lhs;
+    } else {
+        len = sess.streaming ? eval_result(r, sess, out) : eval_held(r, sess, out);
     }
-};
+    if (newline) out[len++] = '\n';
+    reset_request(r, sess);
 
-static void set_nonblocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    uint64_t now = now_ns();
+    r.metrics.completed.add();
+    r.metrics.last_byte_to_result.record(now - last_byte_ns);
+    emit_reply(r, sess, out, len);
+    if (sess.awaiting.empty() && sess.unsent_ns == 0) sess.unsent_ns = now;
 }
 
-struct ClientSession {
-    std::string recv_buf;
-    std::string send_buf;
-    size_t send_offset = 0;
-};
+// Двоичный кадр вычислен: ответ фиксированной длины в очередь отправки
+static void complete_binary(Reactor &r, ClientSession &sess, bool ok, double value,
+                            uint64_t last_byte_ns) {
+    char out[kBinaryResultSize];
+    encode_binary_result(ok, value, out);
+    queue_output(r, sess, out, sizeof(out));
+    sess.request_ms = 0;
+    if (!ok) r.metrics.parse_errors.add();
+    uint64_t now = now_ns();
+    r.metrics.completed.add();
+    r.metrics.last_byte_to_result.record(now - last_byte_ns);
+    if (sess.unsent_ns == 0) sess.unsent_ns = now;
+}
+
+// Разбор прочитанного фрагмента. Первый байт соединения выбирает протокол:
+// kBinaryMagic — двоичные кадры, иначе текст. В текстовом режиме keep-alive поток
+// делится на запросы по '\n' (пустые строки пропускаются), иначе весь поток —
+// одно выражение. read_ns — момент чтения фрагмента.
+static void consume_input(Reactor &r, ClientSession &sess, const char *data, size_t len,
+                          uint64_t read_ns) {
+    r.metrics.bytes_in.add(len);
+    if (r.capture) r.capture->record(CaptureEvent::In, read_ns, capture_conn(r, sess), data, len);
+    if (sess.accepted_ns) {
+        r.metrics.accept_to_first_byte.record(read_ns - sess.accepted_ns);
+        sess.accepted_ns = 0;
+    }
+    if (sess.proto == ClientSession::Proto::Unknown) {
+        sess.proto = ClientSession::Proto::Text;
+        if ((unsigned char)data[0] == kBinaryMagic) {
+            sess.proto = ClientSession::Proto::Binary;
+            ++data;
+            --len;
+        }
+    }
+    if (sess.proto == ClientSession::Proto::Binary) {
+        // кадры самоограничены, поэтому их может быть много и без --keep-alive
+        sess.bin.feed(data, len, sess.eval, [&](bool ok, double value) {
+            complete_binary(r, sess, ok, value, read_ns);
+        });
+        return;
+    }
+    if (!r.cfg.keep_alive) {
+        feed_expr(r, sess, data, len);
+        return;
+    }
+    while (len > 0) {
+        const char *nl = static_cast<const char *>(memchr(data, '\n', len));
+        size_t part = nl ? size_t(nl - data) : len;
+        feed_expr(r, sess, data, part);
+        if (!nl) break;
+        if (sess.recv_bytes > 0) complete_request(r, sess, true, read_ns);
+        data += part + 1;
+        len -= part + 1;
+    }
+}
+
+// Отправка накопленных ответов прямо из блоков очереди (writev); false — соединение сломано
+static bool flush_output(Reactor &r, ClientSession &sess) {
+    bool progress = false;
+    while (!sess.out.empty()) {
+        iovec iov[kWriteBlocks];
+        int cnt = 0;
+        for (const BufferBlock *b = sess.out.front(); b && cnt < kWriteBlocks; b = b->next)
+            iov[cnt++] = {const_cast<char *>(b->data() + b->begin), size_t(b->end - b->begin)};
+        ssize_t w = writev(sess.fd, iov, cnt);
+        if (w > 0) {
+            progress = true;
+            sess.out.consume((size_t)w);
+            r.metrics.bytes_out.add((uint64_t)w);
+        }
+        else if (errno == EAGAIN) {
+            r.metrics.write_eagain.add();
+            break;
+        }
+        else {
+            LOG_WARN("[CLIENT fd=%d] write: %s", sess.fd, strerror(errno));
+            return false;
+        }
+    }
+    if (sess.out.empty()) {
+        // при конвейере учитывается самый старый ответ из отправленной пачки
+        if (sess.unsent_ns) {
+            r.metrics.result_to_sent.record(now_ns() - sess.unsent_ns);
+            sess.unsent_ns = 0;
+        }
+        sess.write_ms = 0;
+    } else if (progress || sess.write_ms == 0) {
+        sess.write_ms = r.now_ms; // срок записи отсчитывается от последнего продвижения
+    }
+    return true;
+}
+
+ReactorControl::ReactorControl() : efd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (efd_ < 0) throw std::runtime_error("eventfd failed");
+}
+
+ReactorControl::~ReactorControl() {
+    close(efd_);
+}
+
+void ReactorControl::wake() {
+    uint64_t one = 1;
+    ssize_t w = write(efd_, &one, sizeof(one));
+    (void)w;
+}
+
+void ReactorControl::consume_wakeup() {
+    uint64_t v;
+    ssize_t r = read(efd_, &v, sizeof(v));
+    (void)r;
+}
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <port>\n";
-        return 1;
+void ReactorControl::post(const OffloadResult &res) {
+    {
+        std::lock_guard<std::mutex> lk(results_m_);
+        results_.push_back(res);
     }
-    int port = std::stoi(argv[1]);
-    std::cout << "Starting server on port " << port << "...\n";
+    wake();
+}
+
+void ReactorControl::take_results(std::vector<OffloadResult> &out) {
+    std::lock_guard<std::mutex> lk(results_m_);
+    out.swap(results_);
+}
 
+void ReactorControl::request_drain() {
+    drain_.store(true, std::memory_order_release);
+    wake();
+}
+
+void ReactorControl::request_stop() {
+    stop_.store(true, std::memory_order_release);
+    wake();
+}
+
+int make_listener(int port, bool reuse_port, int backlog) {
     int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) throw std::runtime_error("socket failed");
     int opt = 1;
     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuse_port &&
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        close(listen_fd);
+        throw std::runtime_error("SO_REUSEPORT failed");
+    }
     sockaddr_in addr{};
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
     addr.sin_port = htons(port);
-    bind(listen_fd, (sockaddr*)&addr, sizeof(addr));
-    listen(listen_fd, 10);
+    if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(listen_fd);
+        throw std::runtime_error("bind failed");
+    }
+    if (listen(listen_fd, backlog) < 0) {
+        close(listen_fd);
+        throw std::runtime_error("listen failed");
+    }
     set_nonblocking(listen_fd);
+    return listen_fd;
+}
 
-    Epoll ep;
-    ep.add(listen_fd, EPOLLIN);
+// Привязка текущего потока к ядру
+static void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) LOG_WARN("[REACTOR] pthread_setaffinity_np failed: %d", rc);
+}
 
-    std::unordered_map<int, ClientSession> sessions;
-    epoll_event events[64];
+// Ядро реактора id или -1, если реакторы не привязываются
+static int reactor_cpu(const ServerConfig &cfg, int id) {
+    if (!cfg.cpus.empty()) return cfg.cpus[(size_t)id % cfg.cpus.size()];
+    if (!cfg.pin_cpus) return -1;
+    int ncpu = (int)std::thread::hardware_concurrency();
+    return ncpu > 0 ? id % ncpu : id;
+}
+
+// Настройка принятого соединения в режиме busy-poll: ответы уходят сразу,
+// без склейки Нагла, а чтение может опрашивать очередь сетевой карты
+static void tune_client_socket(const Reactor &r, int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (r.busy_poll_us > 0)
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &r.busy_poll_us, sizeof(r.busy_poll_us));
+}
+
+// Сколько при завершении процесса ждать запроса от молчащего соединения,
+// прежде чем закрыть его: запрос мог быть уже отправлен
+static const uint64_t kDrainGraceMs = 1000;
+
+// При завершении соединение можно закрыть, когда уйдут ответы: все запросы
+// вычислены, начатых нет
+static bool drain_quiet(const Reactor &r, const ClientSession &sess) {
+    return r.draining && !sess.shut && !sess.peer_closed && sess.recv_bytes == 0 &&
+           !sess.bin.in_frame() && sess.awaiting.empty();
+}
+
+static bool drain_idle(const Reactor &r, const ClientSession &sess) {
+    return drain_quiet(r, sess) && sess.out.empty();
+}
+
+// Срок, к которому с соединением должно что-то произойти, иначе оно закрывается:
+// застряла запись — write_timeout от последнего продвижения, начат запрос —
+// read_timeout от его начала (медленная передача по байту не продлевает срок),
+// иначе — idle_timeout от последнего байта. 0 — срока нет. При завершении
+// процесса простаивающее соединение получает FIN, промолчав kDrainGraceMs.
+static uint64_t session_deadline(const Reactor &r, const ClientSession &sess) {
+    const ServerConfig &cfg = r.cfg;
+    if (drain_idle(r, sess)) // пора отправить FIN
+        return std::max(sess.active_ms, r.drain_start_ms) + kDrainGraceMs;
+    if (!sess.awaiting.empty()) return 0; // ответ считается в пуле — ждёт сервер, а не клиент
+    if (!sess.out.empty())
+        return cfg.write_timeout_ms > 0 ? sess.write_ms + cfg.write_timeout_ms : 0;
+    if (sess.request_ms)
+        return cfg.read_timeout_ms > 0 ? sess.request_ms + cfg.read_timeout_ms : 0;
+    return cfg.idle_timeout_ms > 0 ? sess.active_ms + cfg.idle_timeout_ms : 0;
+}
+
+// Поставить таймер соединения. Более ранний срок ставится сразу, более поздний —
+// лениво, когда сработает уже стоящий таймер: так обычная активность не трогает колесо.
+static void arm_timer(Reactor &r, ClientSession &sess) {
+    uint64_t deadline = session_deadline(r, sess);
+    if (deadline == 0) return;
+    if (!TimerWheel::scheduled(&sess.timer) || deadline < sess.timer.deadline_ms)
+        r.timers.schedule(&sess.timer, deadline);
+}
+
+static void close_session(Reactor &r, Epoll &ep, SessionSlab &sessions, ClientSession &sess) {
+    r.timers.cancel(&sess.timer);
+    ep.remove(sess.fd);
+    close(sess.fd);
+    drop_held(r, sess);
+    sessions.release(&sess);
+    if (r.max_conns) r.conns->fetch_sub(1, std::memory_order_relaxed);
+    r.metrics.active.sub();
+}
+
+// Мягкое закрытие при завершении процесса: FIN, а ввод дочитывается и
+// отбрасывается до EOF клиента, чтобы RST не уничтожил не прочитанные им ответы
+static void shut_session(ClientSession &sess) {
+    shutdown(sess.fd, SHUT_WR);
+    sess.shut = true;
+}
+
+// Отправка ответов; при завершении процесса последний ответ уходит одним
+// сегментом с FIN (TCP_CORK), так что клиент видит EOF сразу за ответом и не
+// успевает отправить в это соединение новый запрос. false — соединение сломано.
+static bool flush_or_finish(Reactor &r, ClientSession &sess) {
+    if (!drain_quiet(r, sess) || sess.out.empty()) return flush_output(r, sess);
+    int on = 1, off = 0;
+    setsockopt(sess.fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    bool ok = flush_output(r, sess);
+    if (ok && sess.out.empty()) shut_session(sess);
+    setsockopt(sess.fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+    return ok;
+}
 
+// Обработка клиентского сокета: чтение и вычисление, отправка ответов, закрытие
+// и смена маски в epoll. Вызывается по событию сокета и после доставки ответа пула.
+static void service_client(Reactor &r, Epoll &ep, SessionSlab &sessions, ClientSession &sess,
+                           bool readable) {
+    int fd = sess.fd;
+    bool broken = false;
     while (true) {
-        int ne = ep.wait(events, 64, -1);
+        // читаем всё до EOF или EAGAIN, сразу скармливая фрагменты вычислителю;
+        // при переполнении очереди ответов чтение откладывается
+        bool throttled = false;
+        if (readable && !sess.peer_closed) {
+            iovec iov[kReadBlocks];
+            for (int i = 0; i < kReadBlocks; ++i) iov[i] = {r.rx[i]->data(), r.buffers.capacity()};
+            while (true) {
+                if (output_full(sess)) {
+                    throttled = true;
+                    break;
+                }
+                ssize_t n = readv(fd, iov, kReadBlocks);
+                if (n > 0) {
+                    sess.active_ms = r.now_ms;
+                    if (sess.shut) continue; // после FIN ввод отбрасывается
+                    uint64_t read_ns = now_ns();
+                    for (int i = 0; n > 0; ++i) {
+                        size_t part = std::min((size_t)n, r.buffers.capacity());
+                        consume_input(r, sess, r.rx[i]->data(), part, read_ns);
+                        n -= (ssize_t)part;
+                    }
+                }
+                else if (n == 0) {
+                    sess.peer_closed = true;
+                    if (r.capture) r.capture->record(CaptureEvent::Eof, now_ns(), capture_conn(r, sess));
+                    break;
+                }
+                else if (errno == EAGAIN) {
+                    r.metrics.read_eagain.add();
+                    break;
+                }
+                else {
+                    LOG_WARN("[CLIENT fd=%d] read: %s", fd, strerror(errno));
+                    broken = true;
+                    break;
+                }
+            }
+            // незавершённое выражение на EOF отвечается как в одноразовом режиме
+            if (sess.peer_closed && sess.recv_bytes > 0) complete_request(r, sess, false, now_ns());
+            if (sess.request_ms == 0 && (sess.recv_bytes > 0 || sess.bin.in_frame()))
+                sess.request_ms = r.now_ms;
+        }
+        if (!broken) broken = !flush_or_finish(r, sess);
+        // по фронту повторного EPOLLIN не будет: если очередь успела освободиться,
+        // дочитываем сокет сразу
+        if (broken || !throttled || output_full(sess))
+            break;
+    }
+
+    bool pending = !sess.out.empty();
+    if (broken || (sess.peer_closed && !pending && sess.awaiting.empty())) {
+        LOG_DEBUG("[CLIENT fd=%d] Closing", fd);
+        close_session(r, ep, sessions, sess);
+        return;
+    }
+    // меняем маску одним EPOLL_CTL_MOD и только если она действительно изменилась
+    uint32_t want = 0;
+    if (!sess.peer_closed && !output_full(sess)) want |= EPOLLIN;
+    if (pending) want |= EPOLLOUT;
+    if (want != sess.events) {
+        ep.modify(fd, want | kClientEvents, &sess);
+        sess.events = want;
+    }
+    arm_timer(r, sess);
+}
+
+// Срок истёк (или пора проверить): закрываем соединение либо переставляем таймер
+static void expire_session(Reactor &r, Epoll &ep, SessionSlab &sessions, ClientSession &sess) {
+    uint64_t deadline = session_deadline(r, sess);
+    if (deadline == 0) return;
+    if (deadline > r.now_ms) {
+        r.timers.schedule(&sess.timer, deadline);
+        return;
+    }
+    if (drain_idle(r, sess)) {
+        // молчит kDrainGraceMs и после начала завершения: запроса в пути уже нет
+        shut_session(sess);
+        arm_timer(r, sess);
+        return;
+    }
+    LOG_DEBUG("[CLIENT fd=%d] Timed out (%s)", sess.fd,
+              !sess.out.empty() ? "write" : sess.request_ms ? "read" : "idle");
+    r.metrics.timeouts.add();
+    close_session(r, ep, sessions, sess);
+}
+
+// Сокеты отданы преемнику: очередь слушающего сокета теперь разбирает он, а
+// реактор дообслуживает свои соединения и завершается
+static void start_drain(Reactor &r, Epoll &ep, SessionSlab &sessions, int listen_fd) {
+    r.draining = true;
+    r.drain_start_ms = r.now_ms;
+    if (r.cfg.drain_timeout_ms > 0) r.drain_deadline_ms = r.now_ms + (uint64_t)r.cfg.drain_timeout_ms;
+    if (r.accept_paused) r.timers.cancel(&r.accept_retry);
+    else ep.remove(listen_fd);
+    r.accept_paused = false;
+    LOG_INFO("[REACTOR %d] Stopped accepting, draining %zu connection(s)", r.id, sessions.active());
+    sessions.for_each([&](ClientSession &sess) { arm_timer(r, sess); });
+}
+
+// Память пула буферов в метрику: учитывается только разница с прошлым разом
+static void sync_buffer_metric(Reactor &r) {
+    size_t bytes = r.buffers.allocated() * r.buffers.block_size();
+    if (bytes > r.buffer_bytes) r.metrics.buffer_bytes.add(bytes - r.buffer_bytes);
+    else if (bytes < r.buffer_bytes) r.metrics.buffer_bytes.sub(r.buffer_bytes - bytes);
+    r.buffer_bytes = bytes;
+}
+
+// Выборка очереди установленных соединений: accept4 до EAGAIN, но не больше
+// kAcceptBatch за событие, чтобы всплеск подключений не задерживал уже открытые
+// соединения. Слушающий сокет зарегистрирован по уровню, остаток придёт следующим событием.
+static const int kAcceptBatch = 64;
+
+// Пауза приёма, когда дескрипторы или память кончились: соединения ждут в очереди
+// слушающего сокета, а реактор не крутится на событии, которое повторится сразу
+static const uint64_t kAcceptBackoffMs = 100;
+// Ошибки accept4 пишутся в журнал не чаще раза в секунду
+static const uint64_t kAcceptWarnMs = 1000;
+
+static void warn_accept(Reactor &r, int err) {
+    if (r.accept_warn_ms && r.now_ms - r.accept_warn_ms < kAcceptWarnMs) {
+        ++r.accept_warn_skipped;
+        return;
+    }
+    if (r.accept_warn_skipped)
+        LOG_WARN("[REACTOR %d] accept4: %s (%llu more since the last report)", r.id, strerror(err),
+                 (unsigned long long)r.accept_warn_skipped);
+    else
+        LOG_WARN("[REACTOR %d] accept4: %s", r.id, strerror(err));
+    r.accept_warn_ms = r.now_ms;
+    r.accept_warn_skipped = 0;
+}
+
+static void accept_batch(Reactor &r, Epoll &ep, SessionSlab &sessions, int listen_fd) {
+    for (int k = 0; k < kAcceptBatch; ++k) {
+        int client = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            // EAGAIN — очередь пуста (или соединение забрал другой реактор)
+            int err = errno;
+            if (err == ECONNABORTED) continue;
+            if (err == EAGAIN || err == EWOULDBLOCK) return;
+            warn_accept(r, err);
+            if (err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM) {
+                // слушающий сокет по уровню сообщил бы о той же очереди сразу же
+                ep.remove(listen_fd);
+                r.accept_paused = true;
+                r.timers.schedule(&r.accept_retry, r.now_ms + kAcceptBackoffMs);
+            }
+            return;
+        }
+        if (r.max_conns && r.conns->fetch_add(1, std::memory_order_relaxed) >= r.max_conns) {
+            // сверх лимита: сразу RST, без буферов, сессии и TIME_WAIT на сервере
+            r.conns->fetch_sub(1, std::memory_order_relaxed);
+            linger lg{1, 0};
+            setsockopt(client, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+            close(client);
+            r.metrics.rejected.add();
+            continue;
+        }
+        if (r.cfg.busy_poll) tune_client_socket(r, client);
+        ClientSession *s = sessions.acquire(client);
+        s->events = EPOLLIN;
+        s->accepted_ns = now_ns();
+        s->active_ms = r.now_ms;
+        if (r.capture) r.capture->record(CaptureEvent::Open, s->accepted_ns, capture_conn(r, *s));
+        r.metrics.accepted.add();
+        r.metrics.active.add();
+        ep.add(client, EPOLLIN | kClientEvents, s);
+        arm_timer(r, *s);
+        LOG_DEBUG("[CONN] Accepted fd=%d (reactor %d)", client, r.id);
+    }
+}
+
+void run_reactor(int listen_fd, int id, const ServerConfig &cfg, ReactorMetrics &metrics,
+                 ReactorControl &control, WorkPool *pool, CaptureFile *capture,
+                 std::atomic<size_t> *conns) {
+    uint64_t now_ms = now_ns() / 1000000;
+    Reactor r{id, cfg, metrics, control, pool, nullptr, {}, now_ms,
+              TimerWheel(kTimerTickMs, kTimerSlots, now_ms),
+              cfg.max_conns > 0 ? (size_t)cfg.max_conns : 0,
+              cfg.busy_poll ? cfg.busy_poll_us : 0,
+              BufferPool(kBufferBlockSize, kMaxFreeBlocks)};
+    std::atomic<size_t> own_conns{0};
+    r.conns = conns ? conns : &own_conns;
+    for (auto &block : r.rx) block = r.buffers.acquire();
+    if (capture) {
+        r.capture.reset(new CaptureBuffer(*capture));
+        r.capture_flush_ms = now_ms;
+    }
+    if (cfg.cache_bytes > 0)
+        r.cache.reset(new ResultCache(cfg.cache_bytes / (size_t)std::max(cfg.threads, 1)));
+    r.held_budget = cfg.offload_budget_bytes / (size_t)std::max(cfg.threads, 1);
+    int cpu = reactor_cpu(cfg, id);
+    if (cpu >= 0) {
+        pin_to_cpu(cpu);
+#ifdef SO_INCOMING_CPU
+        // ядро отдаёт соединение тому из сокетов SO_REUSEPORT, чьё ядро
+        // обработало входящий пакет: реактор и прерывание сетевой карты совпадают
+        if (cfg.threads > 1 && setsockopt(listen_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0)
+            LOG_WARN("[REACTOR] SO_INCOMING_CPU: %s", strerror(errno));
+#endif
+    }
+    // SO_BUSY_POLL выше net.core.busy_read требует CAP_NET_ADMIN: проверяем один раз
+    // на слушающем сокете, чтобы не получать EPERM на каждом accept
+    if (r.busy_poll_us > 0 &&
+        setsockopt(listen_fd, SOL_SOCKET, SO_BUSY_POLL, &r.busy_poll_us, sizeof(r.busy_poll_us)) < 0) {
+        if (id == 0) LOG_WARN("[REACTOR] SO_BUSY_POLL: %s, option ignored", strerror(errno));
+        r.busy_poll_us = 0;
+    }
+
+    Epoll ep(cfg.backend);
+    if (id == 0 && ep.backend() != cfg.backend)
+        LOG_WARN("[REACTOR] io_uring is not available, falling back to epoll");
+    EventSlot listener;
+    listener.fd = listen_fd;
+    listener.kind = EventSlot::Listener;
+    ep.add(listen_fd, EPOLLIN, &listener);
+
+    EventSlot wakeup;
+    wakeup.fd = control.wake_fd();
+    wakeup.kind = EventSlot::Wakeup;
+    ep.add(wakeup.fd, EPOLLIN, &wakeup);
+
+    SessionSlab sessions(r.buffers);
+    epoll_event events[64];
+    std::vector<OffloadResult> results;
+    uint64_t busy_idle_ns = (uint64_t)std::max(cfg.busy_idle_us, 0) * 1000;
+    uint64_t woke_ns = now_ns(), last_event_ns = woke_ns;
+    bool spinning = cfg.busy_poll;
+
+    while (!control.stop_requested()) {
+        if (!r.draining && control.drain_requested()) start_drain(r, ep, sessions, listen_fd);
+        if (r.draining && sessions.active() == 0) break;
+        if (r.draining && r.drain_deadline_ms && r.now_ms >= r.drain_deadline_ms) {
+            LOG_WARN("[REACTOR %d] Drain timeout, closing %zu connection(s)", r.id, sessions.active());
+            break;
+        }
+        // busy-poll: не засыпаем, пока после последнего события прошло меньше busy_idle_us
+        bool spin = cfg.busy_poll && (busy_idle_ns == 0 || woke_ns - last_event_ns < busy_idle_ns);
+        if (spinning && !spin) metrics.busy_sleeps.add(); // считается переход к сну, а не каждое ожидание
+        spinning = spin;
+        int timeout = spin ? 0 : r.timers.timeout_ms(r.now_ms);
+        if (r.draining && (timeout < 0 || timeout > (int)kTimerTickMs)) timeout = (int)kTimerTickMs; // срок остановки
+        if (r.capture && !r.capture->empty() && (timeout < 0 || timeout > (int)kCaptureFlushMs))
+            timeout = (int)kCaptureFlushMs; // записанное не залёживается в памяти реактора
+        int ne = ep.wait(events, 64, timeout);
+        woke_ns = now_ns();
+        r.now_ms = woke_ns / 1000000;
+        if (ne > 0) last_event_ns = woke_ns;
         for (int ei = 0; ei < ne; ++ei) {
-            int fd = events[ei].data.fd;
+            auto *slot = static_cast<EventSlot *>(events[ei].data.ptr);
             uint32_t ev = events[ei].events;
 
-            if (fd == listen_fd) {
-                // новое соединение
-                int client = accept(listen_fd, nullptr, nullptr);
-                set_nonblocking(client);
-                ep.add(client, EPOLLIN);
-                sessions[client] = {};
-                std::cout << "[CONN] Accepted fd=" << client << "\n";
+            if (slot->kind == EventSlot::Wakeup) {
+                control.consume_wakeup();
+                // ответы пула; соединение могло закрыться, а fd — достаться новому
+                control.take_results(results);
+                for (const auto &res : results) {
+                    ClientSession *s = sessions.find(res.fd);
+                    if (!s || s->gen != res.session_gen) continue;
+                    deliver_offloaded(r, *s, res);
+                    service_client(r, ep, sessions, *s, true);
+                }
+                results.clear();
                 continue;
             }
 
-            auto &sess = sessions[fd];
-            if (ev & EPOLLIN) {
-                // читаем всё до EOF или EAGAIN
-                char buf[1024];
-                bool closed = false;
-                while (true) {
-                    ssize_t r = read(fd, buf, sizeof(buf));
-                    if (r > 0) sess.recv_buf.append(buf, r);
-                    else if (r == 0) { closed = true; break; }
-                    else if (errno == EAGAIN) break;
-                    else { perror("read"); closed = true; break; }
-                }
-                if (closed && !sess.recv_buf.empty()) {
-                    std::cout << "[CLIENT fd="<<fd<<"] Expr='"<<sess.recv_buf<<"'\n";
-                    try {
-                        ExprParser p(sess.recv_buf);
-                        double res = p.parse();
-                        sess.send_buf = std::to_string(res);
-                    } catch (...) {
-                        sess.send_buf = "ERROR";
-                    }
-                    sess.send_offset = 0;
-                    ep.remove(fd);
-                    ep.add(fd, EPOLLOUT);
-                }
+            if (slot->kind == EventSlot::Listener) {
+                accept_batch(r, ep, sessions, listen_fd);
+                continue;
+            }
+
+            // сессию могли закрыть раньше в этой же пачке (ответ пула, ошибка записи)
+            auto &sess = *static_cast<ClientSession *>(slot);
+            if (sess.fd < 0) continue;
+            bool readable = (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0;
+            service_client(r, ep, sessions, sess, readable);
+        }
+        r.timers.advance(r.now_ms, [&](TimerNode *node) {
+            if (node == &r.accept_retry) {
+                r.accept_paused = false;
+                ep.add(listen_fd, EPOLLIN, &listener);
+                return;
+            }
+            expire_session(r, ep, sessions, *static_cast<ClientSession *>(node->owner));
+        });
+        sync_buffer_metric(r);
+        if (r.capture && (r.capture->full() || r.now_ms - r.capture_flush_ms >= kCaptureFlushMs)) {
+            r.capture->flush();
+            r.capture_flush_ms = r.now_ms;
+        }
+    }
+    // остановка: закрываем оставшиеся соединения
+    sessions.for_each([&](ClientSession &sess) {
+        close(sess.fd);
+        sessions.release(&sess);
+        if (r.max_conns) r.conns->fetch_sub(1, std::memory_order_relaxed);
+        metrics.active.sub();
+    });
+    for (BufferBlock *block : r.rx) r.buffers.release(block);
+    sync_buffer_metric(r);
+}
+
+// Клиент страницы статистики. Запрос читается и ответ пишется без блокировки,
+// так что медленный клиент не задерживает ни дамп по SIGUSR1, ни передачу сокетов
+struct AdminClient {
+    uint64_t deadline_ms;
+    std::string resp;  // пусто — запрос ещё не прочитан
+    size_t off = 0;
+};
+
+// Сколько клиент статистики может занимать соединение
+static const uint64_t kAdminTimeoutMs = 1000;
+
+// Отправка ответа; true — соединение можно закрывать
+static bool admin_write(int fd, AdminClient &c) {
+    while (c.off < c.resp.size()) {
+        ssize_t w = send(fd, c.resp.data() + c.off, c.resp.size() - c.off, MSG_NOSIGNAL);
+        if (w > 0) c.off += (size_t)w;
+        else return w < 0 && errno != EAGAIN;
+    }
+    return true;
+}
+
+void run_admin(int admin_fd, int signal_fd, int stop_fd, const MetricsRegistry &registry,
+               const HandoffPlan &handoff) {
+    Epoll ep;
+    if (admin_fd >= 0) {
+        set_nonblocking(admin_fd); // сокет мог достаться от прежнего процесса блокирующим
+        ep.add(admin_fd, EPOLLIN);
+    }
+    ep.add(signal_fd, EPOLLIN);
+    ep.add(stop_fd, EPOLLIN);
+    if (handoff.fd >= 0) ep.add(handoff.fd, EPOLLIN);
+    std::unordered_map<int, AdminClient> clients;
+    epoll_event events[8];
+    bool stop = false;
+    while (!stop) {
+        int ne = ep.wait(events, 8, clients.empty() ? -1 : (int)kTimerTickMs);
+        uint64_t now_ms = now_ns() / 1000000;
+        for (int ei = 0; ei < ne; ++ei) {
+            int fd = events[ei].data.fd;
+            if (fd == stop_fd) {
+                stop = true;
+                continue;
+            }
+            if (fd == handoff.fd) {
+                if (!handoff_give(handoff.fd, handoff.listeners, admin_fd)) continue;
+                LOG_INFO("[HANDOFF] Sockets passed to the new process, draining");
+                ep.remove(handoff.fd);
+                if (admin_fd >= 0) ep.remove(admin_fd);
+                for (ReactorControl *c : handoff.reactors) c->request_drain();
+                continue;
+            }
+            if (fd == signal_fd) {
+                signalfd_siginfo si;
+                while (read(signal_fd, &si, sizeof(si)) == (ssize_t)sizeof(si)) {}
+                std::string body = registry.render_prometheus();
+                fwrite(body.data(), 1, body.size(), stdout);
+                fflush(stdout);
+                continue;
             }
-            if (ev & EPOLLOUT) {
-                // отправляем ответ
-                while (sess.send_offset < sess.send_buf.size()) {
-                    ssize_t w = write(fd,
-                        sess.send_buf.data() + sess.send_offset,
-                        sess.send_buf.size() - sess.send_offset);
-                    if (w > 0) sess.send_offset += w;
-                    else if (errno == EAGAIN) break;
-                    else { perror("write"); break; }
+            if (fd == admin_fd) {
+                int client;
+                while ((client = accept4(admin_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    clients[client] = AdminClient{now_ms + kAdminTimeoutMs, {}, 0};
+                    ep.add(client, EPOLLIN);
                 }
-                if (sess.send_offset >= sess.send_buf.size()) {
-                    std::cout << "[CLIENT fd="<<fd<<"] Response sent, closing\n";
-                    ep.remove(fd);
-                    close(fd);
-                    sessions.erase(fd);
+                continue;
+            }
+            auto it = clients.find(fd);
+            if (it == clients.end()) continue;
+            AdminClient &c = it->second;
+            bool done = false;
+            if (c.resp.empty()) {
+                // запрос короткий и не разбирается: отвечаем на то, что пришло
+                char req[2048];
+                ssize_t got;
+                while ((got = read(fd, req, sizeof(req))) > 0) {}
+                if (got < 0 && errno != EAGAIN) {
+                    done = true;
+                } else {
+                    std::string body = registry.render_prometheus();
+                    c.resp = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                             "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+                    done = admin_write(fd, c);
+                    if (!done) ep.modify(fd, EPOLLOUT);
                 }
+            } else {
+                done = admin_write(fd, c);
+            }
+            if (done) {
+                ep.remove(fd);
+                close(fd);
+                clients.erase(it);
             }
         }
+        // не уложившиеся в срок клиенты закрываются
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (now_ms < it->second.deadline_ms) {
+                ++it;
+                continue;
+            }
+            ep.remove(it->first);
+            close(it->first);
+            it = clients.erase(it);
+        }
+    }
+    for (auto &c : clients) close(c.first);
+}
+
+int make_admin_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("socket failed");
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        throw std::runtime_error("admin bind failed");
     }
-    close(listen_fd);
-    return 0;
+    listen(fd, 16);
+    return fd;
 }
@@ -1,16 +1,123 @@
-//
-// Created by astan on 12.07.25.
-//
-
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "epoll_wrapper.h"
+#include "metrics.h"
+#include "work_pool.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
 
+class CaptureFile;
 
-class server {
+// Параметры запуска сервера
+struct ServerConfig {
+    int port = 0;
+    int threads = 1;      // число реакторов (потоков с собственным epoll)
+    bool pin_cpus = false; // привязывать ли реактор i к ядру i
+    std::vector<int> cpus;  // ядра для реакторов по кругу (пусто — реактор i на ядре i)
+    bool keep_alive = false; // несколько выражений на соединение, каждое завершается '\n'
+    Epoll::Backend backend = Epoll::Backend::Epoll; // механизм ожидания событий
+    int admin_port = 0;   // порт статистики на 127.0.0.1 (0 — выключен)
+    size_t cache_bytes = 0; // лимит памяти кэша ответов на все реакторы (0 — кэша нет)
+    size_t offload_bytes = 0; // выражения от этого размера считаются в пуле потоков (0 — никогда)
+    int offload_threads = 0;  // размер пула (0 — по числу ядер)
+    // До конца выражения соединение придерживает не больше offload_hold_bytes (но не
+    // меньше offload_bytes), а все соединения вместе — offload_budget_bytes, поровну
+    // на реактор; остальные выражения считаются в реакторе по мере прихода
+    size_t offload_hold_bytes = 16 * 1024 * 1024;
+    size_t offload_budget_bytes = 64 * 1024 * 1024;
+    int backlog = 1024;       // очередь установленных соединений (ядро урезает до net.core.somaxconn)
+    int max_conns = 0;        // лимит открытых соединений на все реакторы (0 — без лимита)
+    // Сроки соединения, мс (0 — без срока): простой между запросами, передача
+    // одного запроса целиком, продвижение записи ответов
+    int idle_timeout_ms = 60000;
+    int read_timeout_ms = 30000;
+    int write_timeout_ms = 30000;
+    // Busy-poll: реактор опрашивает события без сна, пока они идут; после
+    // busy_idle_us без событий возвращается к блокирующему ожиданию (0 — никогда)
+    bool busy_poll = false;
+    int busy_idle_us = 50000;
+    int busy_poll_us = 0;     // SO_BUSY_POLL клиентских сокетов, мкс (0 — не ставить)
+    // Обновление без простоя: unix-сокет для передачи слушающих сокетов преемнику
+    // (пусто — выключено) и сколько ждать закрытия соединений после передачи (0 — без срока)
+    std::string handoff_path;
+    int drain_timeout_ms = 30000;
+};
 
+// Ответ, вычисленный вне реактора, для сессии fd
+struct OffloadResult {
+    int fd;
+    uint64_t session_gen;  // поколение сессии: ответ закрытой сессии отбрасывается
+    uint64_t seq;          // номер задачи внутри сессии
+    uint64_t last_byte_ns; // когда был прочитан последний байт запроса
+    bool ok;
+    double value;
 };
 
+// Управление реактором из других потоков: пробуждение через eventfd, остановка
+// и доставка ответов из пула
+class ReactorControl {
+public:
+    ReactorControl();
+    ~ReactorControl();
+    void wake();            // разбудить цикл событий реактора
+    void request_stop();    // попросить реактор завершиться (соединения закрываются)
+    bool stop_requested() const { return stop_.load(std::memory_order_acquire); }
+    // Перестать принимать соединения и завершиться, когда открытые обслужены
+    // (или истечёт cfg.drain_timeout_ms)
+    void request_drain();
+    bool drain_requested() const { return drain_.load(std::memory_order_acquire); }
+
+    int wake_fd() const { return efd_; }
+    void consume_wakeup();  // сбросить счётчик eventfd (вызывает реактор)
+
+    void post(const OffloadResult &res);             // из любого потока; будит реактор
+    void take_results(std::vector<OffloadResult> &out); // забрать всё пришедшее (вызывает реактор)
+
+    ReactorControl(const ReactorControl &) = delete;
+    ReactorControl &operator=(const ReactorControl &) = delete;
+private:
+    int efd_;
+    std::atomic<bool> stop_{false};
+    std::atomic<bool> drain_{false};
+    std::mutex results_m_;
+    std::vector<OffloadResult> results_;
+};
+
+// Создание неблокирующего слушающего сокета на всех интерфейсах; при нескольких
+// реакторах каждый получает свой сокет на том же порту (SO_REUSEPORT).
+// Порт 0 — выбрать свободный (узнать его можно через getsockname).
+int make_listener(int port, bool reuse_port, int backlog = 1024);
+
+// Цикл одного реактора: свой слушающий сокет, свой epoll и своя таблица сессий,
+// общих структур между потоками нет. Возвращается после control.request_stop().
+// Выражения от cfg.offload_bytes байт вычисляются в pool, если он задан; pool
+// должен пережить все реакторы, а control — пул. Если задан capture, трафик
+// соединений записывается в него (--record). conns — общий для реакторов счётчик
+// открытых соединений, по которому соблюдается cfg.max_conns (nullptr — свой у реактора).
+void run_reactor(int listen_fd, int id, const ServerConfig &cfg, ReactorMetrics &metrics,
+                 ReactorControl &control, WorkPool *pool, CaptureFile *capture = nullptr,
+                 std::atomic<size_t> *conns = nullptr);
+
+// Слушающий сокет статистики, только на loopback
+int make_admin_listener(int port);
+
+// Передача сокетов преемнику (--handoff): unix-сокет, на котором он ожидается,
+// что ему отдать и какие реакторы после этого остановить
+struct HandoffPlan {
+    int fd = -1;                           // -1 — передача выключена
+    std::vector<int> listeners;
+    std::vector<ReactorControl *> reactors;
+};
 
+// Поток статистики: отдаёт метрики в формате Prometheus на admin_fd (любой
+// HTTP-запрос) и печатает их в stdout по сигналу из signal_fd (SIGUSR1).
+// admin_fd может быть -1. Когда преемник забирает сокеты по handoff, поток
+// перестаёт обслуживать admin_fd и переводит реакторы в режим завершения.
+// Поток возвращается, когда stop_fd (eventfd) становится читаемым.
+void run_admin(int admin_fd, int signal_fd, int stop_fd, const MetricsRegistry &registry,
+               const HandoffPlan &handoff);
 
 #endif //SERVER_H
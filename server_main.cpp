@@ -0,0 +1,237 @@
+#include "server.h"
+#include "capture.h"
+#include "handoff.h"
+#include "logger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+// Список ядер вида "0,2,4-7"; false — список пуст или с ошибкой
+static bool parse_cpu_list(const std::string &s, std::vector<int> &out) {
+    size_t pos = 0;
+    while (pos < s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos) end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        size_t dash = item.find('-');
+        try {
+            size_t used = 0, used_hi = 0;
+            int lo = std::stoi(item, &used);
+            int hi = lo;
+            if (dash != std::string::npos) {
+                hi = std::stoi(item.substr(dash + 1), &used_hi);
+                if (used != dash || dash + 1 + used_hi != item.size()) return false;
+            }
+            else if (used != item.size()) return false;
+            if (lo < 0 || hi < lo || hi >= CPU_SETSIZE) return false;
+            for (int c = lo; c <= hi; ++c) out.push_back(c);
+        } catch (const std::exception &) {
+            return false;
+        }
+        pos = end + 1;
+    }
+    return !out.empty();
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <port> [--threads N] [--pin] [--keep-alive]"
+                  << " [--backend epoll|io_uring] [--log-level trace|debug|info|warn|error|off]"
+                  << " [--admin-port P] [--cache-mb MB] [--offload-bytes N] [--offload-threads T]"
+                  << " [--offload-hold-mb MB] [--offload-budget-mb MB]"
+                  << " [--backlog N] [--max-conns N] [--idle-timeout S] [--read-timeout S]"
+                  << " [--write-timeout S] [--cpus LIST] [--busy-poll] [--busy-idle-us N]"
+                  << " [--so-busy-poll US] [--handoff PATH] [--drain-timeout S] [--record FILE]\n";
+        return 1;
+    }
+    ServerConfig cfg;
+    std::string record_path;
+    cfg.port = std::stoi(argv[1]);
+    LogLevel log_level = LogLevel::Info; // журнал по соединениям — на уровнях debug/trace
+    for (int a = 2; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--threads" && a + 1 < argc) cfg.threads = std::stoi(argv[++a]);
+        else if (arg == "--pin") cfg.pin_cpus = true;
+        else if (arg == "--keep-alive") cfg.keep_alive = true;
+        else if (arg == "--busy-poll") cfg.busy_poll = true;
+        else if (arg == "--busy-idle-us" && a + 1 < argc) cfg.busy_idle_us = std::stoi(argv[++a]);
+        else if (arg == "--handoff" && a + 1 < argc) cfg.handoff_path = argv[++a];
+        else if (arg == "--drain-timeout" && a + 1 < argc) cfg.drain_timeout_ms = int(std::stod(argv[++a]) * 1000);
+        else if (arg == "--record" && a + 1 < argc) record_path = argv[++a];
+        else if (arg == "--so-busy-poll" && a + 1 < argc) cfg.busy_poll_us = std::stoi(argv[++a]);
+        else if (arg == "--cpus" && a + 1 < argc) {
+            if (!parse_cpu_list(argv[++a], cfg.cpus)) {
+                std::cerr << "Invalid CPU list: " << argv[a] << "\n";
+                return 1;
+            }
+            cfg.pin_cpus = true;
+        }
+        else if (arg == "--admin-port" && a + 1 < argc) cfg.admin_port = std::stoi(argv[++a]);
+        else if (arg == "--offload-bytes" && a + 1 < argc) cfg.offload_bytes = std::stoul(argv[++a]);
+        else if (arg == "--offload-threads" && a + 1 < argc) cfg.offload_threads = std::stoi(argv[++a]);
+        else if (arg == "--offload-hold-mb" && a + 1 < argc)
+            cfg.offload_hold_bytes = (size_t)(std::max(0.0, std::stod(argv[++a])) * 1024 * 1024);
+        else if (arg == "--offload-budget-mb" && a + 1 < argc)
+            cfg.offload_budget_bytes = (size_t)(std::max(0.0, std::stod(argv[++a])) * 1024 * 1024);
+        else if (arg == "--backlog" && a + 1 < argc) cfg.backlog = std::stoi(argv[++a]);
+        else if (arg == "--max-conns" && a + 1 < argc) cfg.max_conns = std::stoi(argv[++a]);
+        else if (arg == "--idle-timeout" && a + 1 < argc) cfg.idle_timeout_ms = int(std::stod(argv[++a]) * 1000);
+        else if (arg == "--read-timeout" && a + 1 < argc) cfg.read_timeout_ms = int(std::stod(argv[++a]) * 1000);
+        else if (arg == "--write-timeout" && a + 1 < argc) cfg.write_timeout_ms = int(std::stod(argv[++a]) * 1000);
+        else if (arg == "--cache-mb" && a + 1 < argc)
+            cfg.cache_bytes = (size_t)(std::max(0.0, std::stod(argv[++a])) * 1024 * 1024);
+        else if (arg == "--log-level" && a + 1 < argc) {
+            if (!parse_log_level(argv[++a], log_level)) {
+                std::cerr << "Unknown log level: " << argv[a] << "\n";
+                return 1;
+            }
+        }
+        else if (arg == "--backend" && a + 1 < argc) {
+            std::string b = argv[++a];
+            if (b == "epoll") cfg.backend = Epoll::Backend::Epoll;
+            else if (b == "io_uring") cfg.backend = Epoll::Backend::IoUring;
+            else {
+                std::cerr << "Unknown backend: " << b << "\n";
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return 1;
+        }
+    }
+    if (cfg.threads < 1) cfg.threads = 1;
+
+    // SIGUSR1 блокируется до запуска потоков (маску наследуют все) и читается
+    // потоком статистики через signalfd
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    Logger::instance().set_level(log_level);
+    Logger::instance().start();
+    LOG_INFO("Starting server on port %d (%d reactor(s))...", cfg.port, cfg.threads);
+    if (cfg.busy_poll)
+        LOG_INFO("Busy-poll mode: reactors spin until %d us without events", cfg.busy_idle_us);
+    if (cfg.cache_bytes > 0)
+        LOG_INFO("Result cache: %zu KiB per reactor", cfg.cache_bytes / cfg.threads / 1024);
+
+    std::vector<int> listeners;
+    int admin_fd = -1;
+    int takeover = -1;   // соединение с прежним процессом, которому нужно подтверждение
+    int handoff_fd = -1;
+    try {
+        // прежний процесс на том же --handoff отдаёт свои сокеты: очередь
+        // соединений не теряется, а число реакторов наследуется от него
+        if (!cfg.handoff_path.empty()) {
+            int inherited_admin = -1;
+            takeover = handoff_take(cfg.handoff_path, listeners, inherited_admin);
+            if (takeover >= 0) {
+                if ((int)listeners.size() != cfg.threads)
+                    LOG_WARN("Inherited %zu listener(s), running %zu reactor(s) instead of %d",
+                             listeners.size(), listeners.size(), cfg.threads);
+                cfg.threads = (int)listeners.size();
+                if (cfg.admin_port > 0) admin_fd = inherited_admin;
+                else if (inherited_admin >= 0) close(inherited_admin);
+                LOG_INFO("Took over %zu listener(s) from the previous process", listeners.size());
+            }
+        }
+        if (takeover < 0)
+            for (int i = 0; i < cfg.threads; ++i)
+                listeners.push_back(make_listener(cfg.port, cfg.threads > 1, cfg.backlog));
+        if (cfg.admin_port > 0 && admin_fd < 0) admin_fd = make_admin_listener(cfg.admin_port);
+        if (!cfg.handoff_path.empty()) handoff_fd = make_handoff_listener(cfg.handoff_path);
+    } catch (const std::exception &e) {
+        LOG_ERROR("Failed to listen: %s", e.what());
+        Logger::instance().stop();
+        return 1;
+    }
+
+    // запись трафика: один файл на все реакторы, время — от запуска
+    std::unique_ptr<CaptureFile> capture;
+    if (!record_path.empty()) {
+        try {
+            capture.reset(new CaptureFile(record_path, now_ns()));
+        } catch (const std::exception &e) {
+            LOG_ERROR("Failed to record: %s", e.what());
+            Logger::instance().stop();
+            return 1;
+        }
+        LOG_INFO("Recording traffic to %s", record_path.c_str());
+    }
+
+    MetricsRegistry registry;
+    std::vector<ReactorMetrics *> metrics;
+    for (int i = 0; i < cfg.threads; ++i) metrics.push_back(&registry.add_reactor());
+
+    // Реактор 0 работает в главном потоке, остальные — в отдельных
+    std::vector<std::unique_ptr<ReactorControl>> controls;
+    for (int i = 0; i < cfg.threads; ++i) controls.emplace_back(new ReactorControl);
+
+    // сокеты приняты, прежний процесс может перестать принимать соединения:
+    // до запуска реакторов новые соединения просто ждут в очереди. Только
+    // теперь свой сокет передачи занимает путь прежнего процесса
+    if (takeover >= 0) handoff_confirm(takeover);
+    if (handoff_fd >= 0 && !handoff_publish(cfg.handoff_path)) {
+        close(handoff_fd);
+        handoff_fd = -1;
+    }
+    HandoffPlan handoff;
+    handoff.fd = handoff_fd;
+    handoff.listeners = listeners;
+    for (auto &c : controls) handoff.reactors.push_back(c.get());
+    // поток статистики ссылается на registry и handoff — он останавливается и
+    // присоединяется раньше, чем они исчезнут
+    int admin_stop = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (admin_stop < 0) {
+        LOG_ERROR("eventfd failed: %s", strerror(errno));
+        Logger::instance().stop();
+        return 1;
+    }
+    std::thread admin(run_admin, admin_fd, signal_fd, admin_stop, std::cref(registry), std::cref(handoff));
+    if (admin_fd >= 0) LOG_INFO("Metrics on http://127.0.0.1:%d/metrics", cfg.admin_port);
+    if (handoff_fd >= 0) LOG_INFO("Waiting for a successor on %s", cfg.handoff_path.c_str());
+    // пул объявлен после controls: его потоки останавливаются раньше, чем исчезают адресаты ответов
+    std::unique_ptr<WorkPool> pool;
+    if (cfg.offload_bytes > 0) {
+        int n = cfg.offload_threads > 0 ? cfg.offload_threads : (int)std::thread::hardware_concurrency();
+        pool.reset(new WorkPool(std::max(n, 1)));
+        LOG_INFO("Expressions of %zu+ bytes are evaluated on %d pool thread(s), holding up to %zu KiB each, %zu KiB per reactor",
+                 cfg.offload_bytes, pool->threads(), std::max(cfg.offload_bytes, cfg.offload_hold_bytes) / 1024,
+                 cfg.offload_budget_bytes / cfg.threads / 1024);
+    }
+    std::atomic<size_t> open_conns{0}; // для --max-conns на все реакторы
+    std::vector<std::thread> workers;
+    for (int i = 1; i < cfg.threads; ++i)
+        workers.emplace_back(run_reactor, listeners[i], i, std::cref(cfg), std::ref(*metrics[i]),
+                             std::ref(*controls[i]), pool.get(), capture.get(), &open_conns);
+    run_reactor(listeners[0], 0, cfg, *metrics[0], *controls[0], pool.get(), capture.get(), &open_conns);
+    for (auto &t : workers) t.join();
+    if (capture && capture->dropped())
+        LOG_WARN("Traffic capture lost %llu batch(es): the disk did not keep up",
+                 (unsigned long long)capture->dropped());
+    uint64_t one = 1;
+    ssize_t w = write(admin_stop, &one, sizeof(one));
+    (void)w;
+    admin.join();
+    close(admin_stop);
+    for (int fd : listeners) close(fd);
+    for (int fd : {admin_fd, handoff_fd, signal_fd})
+        if (fd >= 0) close(fd);
+    LOG_INFO("Server stopped");
+    Logger::instance().stop();
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(uint64_t tick_ms, size_t slots, uint64_t now_ms)
+    : tick_ms_(tick_ms ? tick_ms : 1), tick_(now_ms / tick_ms_), slots_(slots ? slots : 1) {
+    for (auto &head : slots_) head.prev = head.next = &head;
+}
+
+void TimerWheel::link(TimerNode *head, TimerNode *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::schedule(TimerNode *node, uint64_t deadline_ms) {
+    if (scheduled(node)) cancel(node);
+    node->deadline_ms = deadline_ms;
+    // ячейка тика, к началу которого срок уже наступит; прошедший срок
+    // сработает на ближайшем тике
+    uint64_t tick = (deadline_ms + tick_ms_ - 1) / tick_ms_;
+    if (tick <= tick_) tick = tick_ + 1;
+    link(&slots_[tick % slots_.size()], node);
+    ++count_;
+}
+
+void TimerWheel::cancel(TimerNode *node) {
+    if (!scheduled(node)) return;
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+    --count_;
+}
+
+int TimerWheel::timeout_ms(uint64_t now_ms) const {
+    if (count_ == 0) return -1;
+    uint64_t next = (tick_ + 1) * tick_ms_;
+    return next > now_ms ? int(next - now_ms) : 0;
+}
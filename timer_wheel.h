@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Узел таймера, встраивается в объект-владелец (интрузивный список)
+struct TimerNode {
+    TimerNode *prev = nullptr;
+    TimerNode *next = nullptr;
+    uint64_t deadline_ms = 0;
+    void *owner = nullptr;   // объект, которому принадлежит узел
+};
+
+// Хешированное колесо таймеров: узел попадает в ячейку deadline / tick по модулю
+// числа ячеек, поэтому постановка и снятие — O(1) без выделения памяти. Срок
+// дальше одного оборота колеса просто переживает лишние проходы по ячейке.
+// Точность — один тик.
+class TimerWheel {
+public:
+    TimerWheel(uint64_t tick_ms, size_t slots, uint64_t now_ms);
+
+    // Поставить (или переставить) узел на срок deadline_ms
+    void schedule(TimerNode *node, uint64_t deadline_ms);
+    void cancel(TimerNode *node);
+    static bool scheduled(const TimerNode *node) { return node->prev != nullptr; }
+
+    // Перевести часы на now_ms; для каждого истёкшего узла вызывается fn(node),
+    // узел к этому моменту уже снят и может быть поставлен заново
+    template <class Fn> void advance(uint64_t now_ms, Fn fn);
+    // Таймаут ожидания событий до следующего тика; -1 — таймеров нет
+    int timeout_ms(uint64_t now_ms) const;
+    size_t size() const { return count_; }
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+private:
+    void link(TimerNode *head, TimerNode *node);
+
+    uint64_t tick_ms_;
+    uint64_t tick_;                 // последний обработанный тик
+    size_t count_ = 0;
+    std::vector<TimerNode> slots_;  // головы кольцевых списков
+};
+
+template <class Fn>
+void TimerWheel::advance(uint64_t now_ms, Fn fn) {
+    uint64_t target = now_ms / tick_ms_;
+    if (target <= tick_) return;
+    // за один вызов каждая ячейка просматривается не больше одного раза
+    uint64_t first = target - tick_ > slots_.size() ? target - slots_.size() + 1 : tick_ + 1;
+    tick_ = target;
+    for (uint64_t t = first; t <= target && count_ > 0; ++t) {
+        TimerNode *head = &slots_[t % slots_.size()];
+        TimerNode *node = head->next;
+        while (node != head) {
+            TimerNode *next = node->next;
+            if (node->deadline_ms <= now_ms) {
+                cancel(node);
+                fn(node);
+            }
+            node = next;
+        }
+    }
+}
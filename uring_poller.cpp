@@ -0,0 +1,230 @@
+#include "uring_poller.h"
+#ifndef _WIN32
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+// user_data для служебных SQE (отмена poll), их CQE игнорируются
+static const uint64_t kIgnoreTag = ~0ULL;
+
+static uint64_t make_tag(int fd, uint32_t gen) {
+    return (uint64_t(gen) << 32) | uint32_t(fd);
+}
+
+UringPoller *UringPoller::create(unsigned entries) {
+    UringPoller *p = new UringPoller;
+    if (!p->setup(entries)) {
+        delete p;
+        return nullptr;
+    }
+    return p;
+}
+
+bool UringPoller::setup(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd < 0) return false;
+    // Нужны: ожидание с таймаутом (EXT_ARG) и многоразовый poll (ядро >= 5.13;
+    // CQE_SKIP появился позже, по нему и проверяем)
+    const unsigned need = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+                          IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+    if ((params.features & need) != need) return false;
+
+    sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (cq_len > sq_len) sq_len = cq_len;
+    cq_len = sq_len; // SINGLE_MMAP: кольца SQ и CQ в одном отображении
+    sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) { sq_ptr = nullptr; return false; }
+    cq_ptr = sq_ptr;
+    sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    void *s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   ring_fd, IORING_OFF_SQES);
+    if (s == MAP_FAILED) return false;
+    sqes = static_cast<io_uring_sqe *>(s);
+
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sq_local_tail = *sq_tail;
+
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+UringPoller::~UringPoller() {
+    if (sqes) munmap(sqes, sqes_len);
+    if (sq_ptr) munmap(sq_ptr, sq_len);
+    if (ring_fd >= 0) close(ring_fd);
+}
+
+// Отправка накопленных SQE и/или ожидание min_complete CQE
+int UringPoller::enter(unsigned min_complete, int timeout) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    // без SQPOLL ядро сдвигает head внутри вызова: не принятое остаётся в очереди
+    unsigned to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    const void *argp = nullptr;
+    size_t argsz = 0;
+    if (min_complete && timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+    int ret = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, argp, argsz);
+    if (ret < 0 && (errno == ETIME || errno == EINTR)) ret = 0;
+    return ret;
+}
+
+unsigned UringPoller::sq_pending() const {
+    return sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+}
+
+// Свободный SQE или nullptr (errno = EBUSY): слот, ещё не принятый ядром,
+// не переиспользуется никогда
+io_uring_sqe *UringPoller::get_sqe() {
+    for (int attempt = 0; sq_pending() >= sq_entries; ++attempt) {
+        // очередь заполнена — отправляем то, что есть; ядро может не принять
+        // ничего (нехватка памяти, переполнение CQ) — тогда пробуем ещё раз
+        if (attempt == kSubmitAttempts) {
+            errno = EBUSY;
+            return nullptr;
+        }
+        enter(0, 0);
+    }
+    unsigned idx = sq_local_tail & *sq_mask;
+    io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    ++sq_local_tail;
+    return sqe;
+}
+
+bool UringPoller::queue_poll(int fd, const Reg &reg) {
+    io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = reg.events & ~(EPOLLET | EPOLLONESHOT);
+    // многоразовый poll работает по фронту; уровень и EPOLLONESHOT — через одноразовый
+    if ((reg.events & EPOLLET) && !(reg.events & EPOLLONESHOT)) sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = make_tag(fd, reg.gen);
+    return true;
+}
+
+bool UringPoller::queue_poll_remove(int fd, uint32_t gen) {
+    io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return false;
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = make_tag(fd, gen);
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = kIgnoreTag;
+    return true;
+}
+
+bool UringPoller::add(int fd, uint32_t events, epoll_data_t data) {
+    if (fd < 0) { errno = EBADF; return false; }
+    if ((size_t)fd >= regs.size()) regs.resize(fd + 1);
+    Reg &r = regs[fd];
+    if (r.active) { errno = EEXIST; return false; }
+    ++r.gen;
+    r.events = events;
+    r.data = data;
+    if (!queue_poll(fd, r)) return false;
+    r.active = true;
+    return true;
+}
+
+bool UringPoller::modify(int fd, uint32_t events, epoll_data_t data) {
+    if (fd < 0 || (size_t)fd >= regs.size() || !regs[fd].active) { errno = ENOENT; return false; }
+    Reg &r = regs[fd];
+    if (!queue_poll_remove(fd, r.gen)) return false;
+    ++r.gen;
+    r.events = events;
+    r.data = data;
+    // старый poll уже отменяется: без нового регистрация снята, как после remove
+    if (!queue_poll(fd, r)) {
+        r.active = false;
+        return false;
+    }
+    return true;
+}
+
+bool UringPoller::remove(int fd) {
+    if (fd < 0 || (size_t)fd >= regs.size() || !regs[fd].active) { errno = ENOENT; return false; }
+    Reg &r = regs[fd];
+    if (!queue_poll_remove(fd, r.gen)) return false;
+    ++r.gen;
+    r.active = false;
+    return true;
+}
+
+// Перевзвод poll из wait: если очередь не принимает, fd ждёт следующей итерации
+void UringPoller::arm(int fd, const Reg &reg) {
+    if (!queue_poll(fd, reg)) rearm.push_back(make_tag(fd, reg.gen));
+}
+
+int UringPoller::wait(epoll_event *events, int maxevents, int timeout) {
+    // poll, не поместившиеся в очередь на прошлой итерации
+    while (!rearm.empty()) {
+        int fd = int(uint32_t(rearm.back()));
+        const Reg &r = regs[fd];
+        // за это время регистрацию могли снять или заменить новой со своим poll
+        if (r.active && r.gen == uint32_t(rearm.back() >> 32) && !queue_poll(fd, r)) break;
+        rearm.pop_back();
+    }
+    unsigned head = *cq_head;
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+        int ret = enter(timeout == 0 ? 0 : 1, timeout);
+        if (ret < 0) return -1;
+    } else if (sq_pending()) {
+        enter(0, 0);
+    }
+    int count = 0;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && count < maxevents) {
+        const io_uring_cqe &cqe = cqes[head & *cq_mask];
+        ++head;
+        if (cqe.user_data == kIgnoreTag) continue;
+        int fd = int(uint32_t(cqe.user_data));
+        uint32_t gen = uint32_t(cqe.user_data >> 32);
+        if ((size_t)fd >= regs.size()) continue;
+        Reg &r = regs[fd];
+        if (!r.active || r.gen != gen) continue; // poll уже отменён
+        bool finished = !(cqe.flags & IORING_CQE_F_MORE);
+        if (cqe.res < 0) {
+            // многоразовый poll может быть прерван ядром (-ECANCELED) — перевзводим
+            if (finished && cqe.res == -ECANCELED) arm(fd, r);
+            continue;
+        }
+        events[count].events = uint32_t(cqe.res);
+        events[count].data = r.data;
+        ++count;
+        if (!finished) continue;
+        if (r.events & EPOLLONESHOT) continue;    // ждём modify, как в epoll
+        arm(fd, r);                               // уровень или оборванный многоразовый poll
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return count;
+}
+#endif
@@ -0,0 +1,65 @@
+#pragma once
+#ifndef _WIN32
+#include <sys/epoll.h>
+#include <cstdint>
+#include <vector>
+
+// Экспериментальный бэкенд Epoll поверх io_uring (Linux): только готовность.
+// Сокеты отслеживаются многоразовыми IORING_OP_POLL_ADD, а add/modify/remove
+// не делают системных вызовов: они лишь кладут SQE в очередь, которая
+// отправляется в ядро вместе с ожиданием — одним io_uring_enter на итерацию
+// цикла событий. accept/read/write остаются обычными системными вызовами
+// (без multishot accept и выделенных буферов), поэтому выигрыш ограничен
+// циклами с частыми modify; см. calc_bench loop/*.
+// Семантика совпадает с epoll: EPOLLET — по фронту (многоразовый poll),
+// без него — по уровню (одноразовый poll, перевзводимый после каждого события),
+// EPOLLONESHOT — до следующего modify.
+class UringPoller {
+public:
+    // nullptr, если io_uring недоступен (старое ядро, запрет seccomp и т.п.)
+    static UringPoller *create(unsigned entries);
+    ~UringPoller();
+
+    bool add(int fd, uint32_t events, epoll_data_t data);
+    bool modify(int fd, uint32_t events, epoll_data_t data);
+    bool remove(int fd);
+    int wait(epoll_event *events, int maxevents, int timeout);
+private:
+    // Регистрация дескриптора; gen отличает актуальный poll от отменённых
+    struct Reg {
+        bool active = false;
+        uint32_t gen = 0;
+        uint32_t events = 0;
+        epoll_data_t data{};
+    };
+
+    UringPoller() = default;
+    bool setup(unsigned entries);
+    static const int kSubmitAttempts = 4; // попыток отправить полную очередь
+
+    struct io_uring_sqe *get_sqe();     // nullptr — очередь полна и ядро её не принимает
+    unsigned sq_pending() const;        // SQE, ещё не принятые ядром
+    bool queue_poll(int fd, const Reg &reg);
+    bool queue_poll_remove(int fd, uint32_t gen);
+    void arm(int fd, const Reg &reg);
+    int enter(unsigned min_complete, int timeout);
+
+    int ring_fd = -1;
+    // SQ
+    void *sq_ptr = nullptr;
+    size_t sq_len = 0;
+    unsigned *sq_head = nullptr, *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+    struct io_uring_sqe *sqes = nullptr;
+    size_t sqes_len = 0;
+    unsigned sq_entries = 0;
+    unsigned sq_local_tail = 0; // хвост очереди с ещё не опубликованными SQE
+    // CQ
+    void *cq_ptr = nullptr;
+    size_t cq_len = 0;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+    struct io_uring_cqe *cqes = nullptr;
+
+    std::vector<Reg> regs; // индекс — номер дескриптора
+    std::vector<uint64_t> rearm; // (gen, fd) poll, которые не удалось перевзвести из wait
+};
+#endif
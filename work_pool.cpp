@@ -0,0 +1,125 @@
+#include "work_pool.h"
+#include "calc_core.h"
+#include <algorithm>
+
+// Номер рабочего потока пула, в котором выполняется код (-1 — чужой поток)
+static thread_local int t_worker = -1;
+static thread_local const WorkPool *t_pool = nullptr;
+
+WorkPool::WorkPool(int threads) {
+    if (threads < 1) threads = 1;
+    for (int i = 0; i < threads; ++i) workers_.emplace_back(new Worker);
+    for (int i = 0; i < threads; ++i) threads_.emplace_back(&WorkPool::worker_loop, this, i);
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lk(sleep_m_);
+        stop_.store(true);
+    }
+    sleep_cv_.notify_all();
+    for (auto &t : threads_) t.join();
+}
+
+void WorkPool::push(size_t worker, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lk(workers_[worker]->m);
+        workers_[worker]->q.push_back(std::move(task));
+    }
+    {
+        // под sleep_m_, чтобы не потерять пробуждение потока, который как раз засыпает
+        std::lock_guard<std::mutex> lk(sleep_m_);
+        queued_.fetch_add(1);
+    }
+    sleep_cv_.notify_one();
+}
+
+void WorkPool::submit(std::function<void()> task) {
+    push(next_.fetch_add(1, std::memory_order_relaxed) % workers_.size(), std::move(task));
+}
+
+bool WorkPool::try_run_one(int self) {
+    std::function<void()> task;
+    if (self >= 0) {
+        Worker &w = *workers_[self];
+        std::lock_guard<std::mutex> lk(w.m);
+        if (!w.q.empty()) {
+            task = std::move(w.q.back());
+            w.q.pop_back();
+        }
+    }
+    for (size_t k = 1; !task && k <= workers_.size(); ++k) {
+        Worker &victim = *workers_[(size_t(self + k) + workers_.size()) % workers_.size()];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if (!victim.q.empty()) {
+            task = std::move(victim.q.front());
+            victim.q.pop_front();
+        }
+    }
+    if (!task) return false;
+    queued_.fetch_sub(1);
+    task();
+    return true;
+}
+
+void WorkPool::worker_loop(int self) {
+    t_worker = self;
+    t_pool = this;
+    while (true) {
+        if (try_run_one(self)) continue;
+        std::unique_lock<std::mutex> lk(sleep_m_);
+        sleep_cv_.wait(lk, [&] { return stop_.load() || queued_.load() > 0; });
+        if (stop_.load()) return;
+    }
+}
+
+void WorkPool::parallel_for(size_t n, const std::function<void(size_t)> &fn) {
+    if (n == 0) return;
+    int self = t_pool == this ? t_worker : -1;
+    std::atomic<size_t> remaining{n};
+    // первую часть вызывающий поток выполнит сам, остальные — в очередь
+    for (size_t i = 1; i < n; ++i) {
+        auto task = [&, i] {
+            fn(i);
+            remaining.fetch_sub(1, std::memory_order_release);
+        };
+        if (self >= 0) push((size_t)self, task);
+        else submit(task);
+    }
+    fn(0);
+    remaining.fetch_sub(1, std::memory_order_release);
+    // пока части выполняются другими, помогаем с любыми задачами пула
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (!try_run_one(self)) std::this_thread::yield();
+    }
+}
+
+// Слагаемые на одну задачу пула: меньше — накладные расходы больше самой работы
+static const size_t kChunkBytes = 16 * 1024;
+
+bool evaluate_parallel(WorkPool &pool, std::string_view expr, double &result) {
+    std::vector<std::string_view> terms;
+    std::vector<char> ops;
+    if (!split_top_level(expr, terms, ops)) return false;
+
+    std::vector<double> values(terms.size());
+    std::atomic<bool> failed{false};
+    size_t chunks = std::min(terms.size(), std::max<size_t>(1, expr.size() / kChunkBytes));
+    pool.parallel_for(chunks, [&](size_t c) {
+        // слагаемые обычно повторяют несколько форм: каждая компилируется один раз на часть
+        ExprCompiler compiler;
+        size_t first = terms.size() * c / chunks, last = terms.size() * (c + 1) / chunks;
+        for (size_t t = first; t < last && !failed.load(std::memory_order_relaxed); ++t) {
+            if (!compiler.evaluate(terms[t], values[t])) failed.store(true, std::memory_order_relaxed);
+        }
+    });
+    if (failed.load()) return false;
+
+    double acc = values[0];
+    for (size_t t = 1; t < values.size(); ++t) {
+        if (ops[t - 1] == '+') acc += values[t];
+        else acc -= values[t];
+    }
+    result = acc;
+    return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Пул потоков с перехватом работы (work stealing). У каждого рабочего потока своя
+// очередь: свои задачи он берёт с конца (последние — ещё в кэше), а оставшись без
+// работы, забирает самые старые задачи из начала чужих очередей.
+class WorkPool {
+public:
+    explicit WorkPool(int threads);
+    ~WorkPool(); // невыполненные задачи отбрасываются
+
+    // Поставить задачу из любого потока
+    void submit(std::function<void()> task);
+    // Выполнить fn(0..n-1) параллельно и дождаться завершения. Вызывающий поток
+    // (в том числе рабочий поток пула) не простаивает, а выполняет задачи сам.
+    void parallel_for(size_t n, const std::function<void(size_t)> &fn);
+
+    int threads() const { return (int)workers_.size(); }
+
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+private:
+    struct Worker {
+        std::mutex m;
+        std::deque<std::function<void()>> q;
+    };
+
+    void push(size_t worker, std::function<void()> task);
+    bool try_run_one(int self);  // self = -1 для потоков вне пула
+    void worker_loop(int self);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex sleep_m_;
+    std::condition_variable sleep_cv_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> next_{0};   // очередь для следующей внешней задачи
+    std::atomic<bool> stop_{false};
+};
+
+// Вычисление большого выражения на пуле: выражение режется по '+' и '-' вне
+// скобок, слагаемые вычисляются параллельно, а затем складываются слева направо.
+// Каждое слагаемое считается целиком и независимо, поэтому результат побитно
+// совпадает с последовательным вычислением. false — выражение некорректно.
+bool evaluate_parallel(WorkPool &pool, std::string_view expr, double &result);